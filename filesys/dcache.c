@@ -0,0 +1,155 @@
+/* dcache.c: Cache of directory lookups.
+ *
+ * Maps a (directory inode sector, name) pair to the inode sector the
+ * name refers to, so that opening the same path again reads no
+ * directory blocks.  A name known to be missing is cached as well,
+ * with sector 0, which no file can have: it is the free map's inode.
+ * dir_add() and dir_remove() update the entry of the name they change;
+ * nothing else changes a directory.  The cache holds at most
+ * DCACHE_MAX entries and drops the least recently used one first. */
+
+#include "filesys/dcache.h"
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Entries kept at most. */
+#define DCACHE_MAX 256
+
+/* A cached lookup. */
+struct dentry {
+	struct hash_elem elem;      /* Element of dcache. */
+	struct list_elem lru_elem;  /* Element of lru, most recent first. */
+	disk_sector_t dir;          /* Inode sector of the directory. */
+	char name[NAME_MAX + 1];    /* Name looked up in DIR. */
+	disk_sector_t sector;       /* Inode sector of NAME, 0 if missing. */
+};
+
+static struct hash dcache;
+static struct list lru;
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long dcache_hits;
+static long long dcache_misses;
+
+static uint64_t
+dcache_hash (const struct hash_elem *e_, void *aux UNUSED) {
+	const struct dentry *e = hash_entry (e_, struct dentry, elem);
+	return hash_string (e->name) ^ hash_int (e->dir);
+}
+
+static bool
+dcache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct dentry *a = hash_entry (a_, struct dentry, elem);
+	const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+	if (a->dir != b->dir)
+		return a->dir < b->dir;
+	return strcmp (a->name, b->name) < 0;
+}
+
+void
+dcache_init (void) {
+	hash_init (&dcache, dcache_hash, dcache_less, NULL);
+	list_init (&lru);
+	lock_init (&dcache_lock);
+}
+
+/* Returns the entry for NAME in DIR, or NULL.  Must be called with
+ * dcache_lock held. */
+static struct dentry *
+dcache_find (disk_sector_t dir, const char *name) {
+	struct dentry key;
+	struct hash_elem *e;
+
+	key.dir = dir;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache, &key.elem);
+	return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Looks NAME up in the directory whose inode is in sector DIR.
+ * Returns false if the cache does not know.  Otherwise returns true
+ * and sets *SECTOR to the inode sector of NAME, or to 0 if DIR has no
+ * file by that name. */
+bool
+dcache_lookup (disk_sector_t dir, const char *name, disk_sector_t *sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return false;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (dir, name);
+	if (d != NULL) {
+		*sector = d->sector;
+		list_remove (&d->lru_elem);
+		list_push_front (&lru, &d->lru_elem);
+		dcache_hits++;
+	} else
+		dcache_misses++;
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector DIR
+ * refers to the inode in SECTOR, or that it is missing if SECTOR is
+ * 0.  Replaces what the cache knew about NAME. */
+void
+dcache_insert (disk_sector_t dir, const char *name, disk_sector_t sector) {
+	struct dentry *d;
+
+	if (strlen (name) > NAME_MAX)
+		return;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (dir, name);
+	if (d == NULL) {
+		if (hash_size (&dcache) >= DCACHE_MAX) {
+			d = list_entry (list_pop_back (&lru), struct dentry, lru_elem);
+			hash_delete (&dcache, &d->elem);
+		} else if ((d = malloc (sizeof *d)) == NULL)
+			goto done;
+		d->dir = dir;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dcache, &d->elem);
+	} else
+		list_remove (&d->lru_elem);
+	d->sector = sector;
+	list_push_front (&lru, &d->lru_elem);
+
+done:
+	lock_release (&dcache_lock);
+}
+
+/* Drops every entry of the directory whose inode is in sector DIR,
+ * which is being removed, so that none outlives the sector's reuse. */
+void
+dcache_forget_dir (disk_sector_t dir) {
+	struct list_elem *e;
+
+	lock_acquire (&dcache_lock);
+	for (e = list_begin (&lru); e != list_end (&lru);) {
+		struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+		e = list_next (e);
+		if (d->dir == dir) {
+			list_remove (&d->lru_elem);
+			hash_delete (&dcache, &d->elem);
+			free (d);
+		}
+	}
+	lock_release (&dcache_lock);
+}
+
+/* Prints lookup statistics. */
+void
+dcache_print_stats (void) {
+	printf ("Dcache: %lld hits, %lld misses\n", dcache_hits, dcache_misses);
+}
@@ -1,9 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -19,6 +23,35 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* A directory that grows to DIR_INDEX_MIN entries gets a hashed index:
+ * a file of its own, found through inode_get_index(), that maps the
+ * hash of a name to the number of its entry.  The entries themselves
+ * stay where they are, so dir_readdir() and directories without an
+ * index work as before; a directory in the linear format gets its
+ * index on the next dir_add(). */
+#define DIR_INDEX_MIN 64
+
+/* Identifies a directory index. */
+#define DIR_INDEX_MAGIC 0x58444e49
+
+/* Start of a directory index file.  The slot table follows. */
+struct dir_index {
+	uint32_t magic;                     /* DIR_INDEX_MAGIC. */
+	uint32_t slot_cnt;                  /* Slots, a power of 2. */
+	uint32_t used_cnt;                  /* Slots not empty. */
+	uint32_t free_head;                 /* First free entry + 1, or 0. */
+};
+
+/* Slot of a directory index.  Free entries of an indexed directory
+ * are chained through their inode_sector, as entry number + 1. */
+struct dir_slot {
+	uint32_t hash;                      /* Hash of the name. */
+	uint32_t entry;                     /* Entry number + 1, 0 if empty. */
+};
+
+/* ENTRY of a slot whose entry was removed. */
+#define SLOT_DELETED UINT32_MAX
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -32,6 +65,7 @@ struct dir *
 dir_open (struct inode *inode) {
 	struct dir *dir = calloc (1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
+		inode_set_meta (inode);
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
@@ -71,20 +105,109 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Returns the hash of NAME in a directory index. */
+static uint32_t
+name_hash (const char *name) {
+	return hash_string (name);
+}
+
+/* Returns the byte offset of slot IDX in a directory index. */
+static off_t
+slot_ofs (uint32_t idx) {
+	return sizeof (struct dir_index) + idx * sizeof (struct dir_slot);
+}
+
+/* Opens the index of DIR and reads its header into *IDX.
+ * Returns a null pointer if DIR has no index. */
+static struct inode *
+index_open (const struct dir *dir, struct dir_index *idx) {
+	disk_sector_t sector = inode_get_index (dir->inode);
+	struct inode *index;
+
+	if (sector == 0 || (index = inode_open (sector)) == NULL)
+		return NULL;
+	inode_set_meta (index);
+	if (inode_read_at (index, idx, sizeof *idx, 0) != sizeof *idx
+			|| idx->magic != DIR_INDEX_MAGIC) {
+		inode_close (index);
+		return NULL;
+	}
+	return index;
+}
+
+/* Searches the index INDEX, with header IDX, of DIR for NAME.  On
+ * success, returns true and sets *EP, *OFSP and *SLOTP to the entry,
+ * its offset and its slot.  Otherwise returns false and sets *SLOTP
+ * to the slot where NAME goes.  EP and OFSP may be null. */
+static bool
+index_lookup (const struct dir *dir, struct inode *index,
+		const struct dir_index *idx, const char *name,
+		struct dir_entry *ep, off_t *ofsp, uint32_t *slotp) {
+	uint32_t hash = name_hash (name);
+	uint32_t mask = idx->slot_cnt - 1;
+	uint32_t free_slot = UINT32_MAX;
+
+	for (uint32_t i = hash & mask, n = 0; n < idx->slot_cnt;
+			i = (i + 1) & mask, n++) {
+		struct dir_slot slot;
+		struct dir_entry e;
+		off_t ofs;
+
+		if (inode_read_at (index, &slot, sizeof slot, slot_ofs (i))
+				!= sizeof slot)
+			break;
+		if (slot.entry == 0) {
+			*slotp = free_slot != UINT32_MAX ? free_slot : i;
+			return false;
+		}
+		if (slot.entry == SLOT_DELETED) {
+			if (free_slot == UINT32_MAX)
+				free_slot = i;
+			continue;
+		}
+		if (slot.hash != hash)
+			continue;
+		ofs = (slot.entry - 1) * sizeof e;
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e
+				&& e.in_use && !strcmp (name, e.name)) {
+			if (ep != NULL)
+				*ep = e;
+			if (ofsp != NULL)
+				*ofsp = ofs;
+			*slotp = i;
+			return true;
+		}
+	}
+	*slotp = free_slot;
+	return false;
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
  * directory entry if OFSP is non-null.
- * otherwise, returns false and ignores EP and OFSP. */
+ * otherwise, returns false and ignores EP and OFSP.
+ * The caller holds the directory lock of DIR's inode. */
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
 	struct dir_entry e;
+	struct dir_index idx;
+	struct inode *index;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	index = index_open (dir, &idx);
+	if (index != NULL) {
+		uint32_t slot;
+		bool found = index_lookup (dir, index, &idx, name, ep, ofsp, &slot);
+
+		inode_close (index);
+		return found;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
 		if (e.in_use && !strcmp (name, e.name)) {
@@ -104,19 +227,214 @@ lookup (const struct dir *dir, const char *name,
 bool
 dir_lookup (const struct dir *dir, const char *name,
 		struct inode **inode) {
+	disk_sector_t dir_sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL))
-		*inode = inode_open (e.inode_sector);
-	else
-		*inode = NULL;
+	dir_sector = inode_get_inumber (dir->inode);
+	if (!dcache_lookup (dir_sector, name, &e.inode_sector)) {
+		/* Closing the index may write it back. */
+		journal_begin ();
+		inode_lock_dir (dir->inode);
+		if (!lookup (dir, name, &e, NULL))
+			e.inode_sector = 0;
+		dcache_insert (dir_sector, name, e.inode_sector);
+		inode_unlock_dir (dir->inode);
+		journal_end ();
+	}
+	*inode = e.inode_sector != 0 ? inode_open (e.inode_sector) : NULL;
 
 	return *inode != NULL;
 }
 
+/* Writes SLOT to slot IDX of INDEX.  Returns true if successful. */
+static bool
+slot_write (struct inode *index, uint32_t idx, uint32_t hash, uint32_t entry) {
+	struct dir_slot slot = { .hash = hash, .entry = entry };
+
+	return inode_write_at (index, &slot, sizeof slot, slot_ofs (idx))
+		== sizeof slot;
+}
+
+/* Builds a new index for DIR from its entries, with room for four
+ * times as many, and replaces the old index, if any.  Free entries
+ * are chained on the way.  Returns true if successful; DIR keeps its
+ * old index, or none, otherwise. */
+static bool
+index_build (struct dir *dir) {
+	enum { CHUNK = 64 };
+	size_t entry_cnt = inode_length (dir->inode) / sizeof (struct dir_entry);
+	struct dir_index idx = { .magic = DIR_INDEX_MAGIC, .slot_cnt = 128 };
+	struct dir_entry *entries = malloc (CHUNK * sizeof *entries);
+	struct dir_slot *slots = NULL;
+	disk_sector_t sector = 0, old = inode_get_index (dir->inode);
+	struct inode *index = NULL;
+	bool success = false;
+	off_t table_size;
+
+	while (idx.slot_cnt < 4 * (entry_cnt + 1))
+		idx.slot_cnt *= 2;
+	table_size = idx.slot_cnt * sizeof *slots;
+	slots = calloc (1, table_size);
+	if (entries == NULL || slots == NULL)
+		goto done;
+
+	/* Fill the slot table in memory, CHUNK entries at a time. */
+	for (size_t base = 0; base < entry_cnt; base += CHUNK) {
+		size_t cnt = entry_cnt - base < CHUNK ? entry_cnt - base : CHUNK;
+		off_t size = cnt * sizeof *entries;
+		off_t ofs = base * sizeof *entries;
+		bool chained = false;
+
+		if (inode_read_at (dir->inode, entries, size, ofs) != size)
+			goto done;
+		for (size_t i = 0; i < cnt; i++) {
+			struct dir_entry *e = &entries[i];
+
+			if (e->in_use) {
+				uint32_t hash = name_hash (e->name);
+				uint32_t s = hash & (idx.slot_cnt - 1);
+
+				while (slots[s].entry != 0)
+					s = (s + 1) & (idx.slot_cnt - 1);
+				slots[s].hash = hash;
+				slots[s].entry = base + i + 1;
+				idx.used_cnt++;
+			} else {
+				e->inode_sector = idx.free_head;
+				idx.free_head = base + i + 1;
+				chained = true;
+			}
+		}
+		if (chained && inode_write_at (dir->inode, entries, size, ofs) != size)
+			goto done;
+	}
+
+	/* The new table is written in place, not through the journal: it
+	 * is reachable only through the directory's inode, which is. */
+	if (!free_map_allocate (1, &sector) || !inode_create (sector, 0)
+			|| (index = inode_open (sector)) == NULL)
+		goto done;
+	if (inode_write_at (index, &idx, sizeof idx, 0) != sizeof idx
+			|| inode_write_at (index, slots, table_size, slot_ofs (0))
+			!= table_size)
+		goto done;
+
+	inode_set_index (dir->inode, sector);
+	if (old != 0) {
+		struct inode *old_index = inode_open (old);
+
+		if (old_index != NULL) {
+			inode_remove (old_index);
+			inode_close (old_index);
+		}
+	}
+	success = true;
+
+done:
+	if (!success && index != NULL)
+		inode_remove (index);
+	else if (!success && sector != 0)
+		free_map_release (sector, 1);
+	inode_close (index);
+	free (slots);
+	free (entries);
+	return success;
+}
+
+/* dir_add() for a directory with an index: the entry goes into the
+ * first free entry, or at the end, without a scan. */
+static bool
+index_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_index idx;
+	struct dir_entry e;
+	struct inode *index = index_open (dir, &idx);
+	struct dir_slot old;
+	uint32_t slot, entry;
+	bool success = false;
+	off_t ofs;
+
+	if (index == NULL)
+		return false;
+	if (index_lookup (dir, index, &idx, name, NULL, NULL, &slot)
+			|| slot == UINT32_MAX)
+		goto done;
+
+	if (idx.free_head != 0) {
+		entry = idx.free_head - 1;
+		ofs = entry * sizeof e;
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+			goto done;
+		idx.free_head = e.inode_sector;
+	} else {
+		ofs = inode_length (dir->inode);
+		entry = ofs / sizeof e;
+	}
+
+	e.in_use = true;
+	strlcpy (e.name, name, sizeof e.name);
+	e.inode_sector = inode_sector;
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+		goto done;
+
+	/* A deleted slot taken over was already counted as used. */
+	if (inode_read_at (index, &old, sizeof old, slot_ofs (slot)) != sizeof old)
+		goto done;
+	if (old.entry == 0)
+		idx.used_cnt++;
+	success = slot_write (index, slot, name_hash (name), entry + 1)
+		&& inode_write_at (index, &idx, sizeof idx, 0) == sizeof idx;
+
+done:
+	inode_close (index);
+	/* Keep the table at most half full. */
+	if (success && idx.used_cnt * 2 > idx.slot_cnt)
+		index_build (dir);
+	return success;
+}
+
+/* dir_remove() for a directory with an index. */
+static bool
+index_remove (struct dir *dir, const char *name) {
+	struct dir_index idx;
+	struct dir_entry e;
+	struct inode *index = index_open (dir, &idx);
+	struct inode *inode = NULL;
+	bool success = false;
+	uint32_t slot;
+	off_t ofs;
+
+	if (index == NULL)
+		return false;
+	if (!index_lookup (dir, index, &idx, name, &e, &ofs, &slot))
+		goto done;
+
+	inode = inode_open (e.inode_sector);
+	if (inode == NULL)
+		goto done;
+
+	/* Free the entry onto the chain and mark its slot deleted. */
+	e.in_use = false;
+	e.inode_sector = idx.free_head;
+	idx.free_head = ofs / sizeof e + 1;
+	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+			|| !slot_write (index, slot, 0, SLOT_DELETED)
+			|| inode_write_at (index, &idx, sizeof idx, 0) != sizeof idx)
+		goto done;
+
+	inode_remove (inode);
+	dcache_insert (inode_get_inumber (dir->inode), name, 0);
+	dcache_forget_dir (inode_get_inumber (inode));
+	success = true;
+
+done:
+	inode_close (inode);
+	inode_close (index);
+	return success;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
  * file by that name.  The file's inode is in sector
  * INODE_SECTOR.
@@ -136,6 +454,13 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (*name == '\0' || strlen (name) > NAME_MAX)
 		return false;
 
+	journal_begin ();
+	inode_lock_dir (dir->inode);
+	if (inode_get_index (dir->inode) != 0) {
+		success = index_add (dir, name, inode_sector);
+		goto done;
+	}
+
 	/* Check that NAME is not in use. */
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
@@ -158,7 +483,15 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+	/* Past the linear format's sweet spot: index it. */
+	if (success && inode_length (dir->inode) >= DIR_INDEX_MIN * (off_t) sizeof e)
+		index_build (dir);
+
 done:
+	if (success)
+		dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+	inode_unlock_dir (dir->inode);
+	journal_end ();
 	return success;
 }
 
@@ -175,6 +508,13 @@ dir_remove (struct dir *dir, const char *name) {
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	journal_begin ();
+	inode_lock_dir (dir->inode);
+	if (inode_get_index (dir->inode) != 0) {
+		success = index_remove (dir, name);
+		goto done;
+	}
+
 	/* Find directory entry. */
 	if (!lookup (dir, name, &e, &ofs))
 		goto done;
@@ -191,10 +531,14 @@ dir_remove (struct dir *dir, const char *name) {
 
 	/* Remove inode. */
 	inode_remove (inode);
+	dcache_insert (inode_get_inumber (dir->inode), name, 0);
+	dcache_forget_dir (e.inode_sector);
 	success = true;
 
 done:
 	inode_close (inode);
+	inode_unlock_dir (dir->inode);
+	journal_end ();
 	return success;
 }
 
@@ -204,13 +548,17 @@ done:
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
+	bool found = false;
 
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
+	inode_lock_dir (dir->inode);
+	while (!found
+			&& inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
 		}
 	}
-	return false;
+	inode_unlock_dir (dir->inode);
+	return found;
 }
@@ -1,4 +1,5 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -22,7 +23,10 @@ struct fat_fs {
 	unsigned int *fat;
 	unsigned int fat_length;
 	disk_sector_t data_start;
-	cluster_t last_clst;
+	cluster_t last_clst;            /* Where the next free search starts. */
+	struct bitmap *used_map;        /* One bit per cluster, set if in use. */
+	struct bitmap *dirty_map;       /* One bit per FAT sector, set if it
+	                                   differs from the disk. */
 	struct lock write_lock;
 };
 
@@ -30,6 +34,7 @@ static struct fat_fs *fat_fs;
 
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_used_map_init (void);
 
 void
 fat_init (void) {
@@ -78,6 +83,7 @@ fat_open (void) {
 			free (bounce);
 		}
 	}
+	fat_used_map_init ();
 }
 
 void
@@ -90,13 +96,22 @@ fat_close (void) {
 	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
 	free (bounce);
 
-	// Write FAT directly to the disk
+	filesys_meta_bytes += DISK_SECTOR_SIZE;
+
+	// Write the FAT sectors that changed directly to the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_wrote = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
 	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
 		bytes_left = fat_size_in_bytes - bytes_wrote;
+		if (!bitmap_test (fat_fs->dirty_map, i)) {
+			bytes_wrote += bytes_left < DISK_SECTOR_SIZE
+				? bytes_left : DISK_SECTOR_SIZE;
+			continue;
+		}
+		bitmap_reset (fat_fs->dirty_map, i);
+		filesys_meta_bytes += DISK_SECTOR_SIZE;
 		if (bytes_left >= DISK_SECTOR_SIZE) {
 			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
 			            buffer + bytes_wrote);
@@ -123,6 +138,9 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_used_map_init ();
+	/* Nothing of the new FAT is on disk yet. */
+	bitmap_set_all (fat_fs->dirty_map, true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -152,42 +170,172 @@ fat_boot_create (void) {
 
 void
 fat_fs_init (void) {
-	/* TODO: Your code goes here. */
+	fat_fs->data_start = fat_fs->bs.fat_start + fat_fs->bs.fat_sectors;
+	/* Cluster 0 means "no cluster", so the first data cluster is 1. */
+	fat_fs->fat_length = (fat_fs->bs.total_sectors - fat_fs->data_start)
+		/ SECTORS_PER_CLUSTER + 1;
+	fat_fs->last_clst = ROOT_DIR_CLUSTER + 1;
+	lock_init (&fat_fs->write_lock);
+}
+
+/* Builds the bitmap of used clusters from the FAT, so that free
+ * clusters are found without scanning the FAT itself, and an empty
+ * bitmap of changed FAT sectors. */
+static void
+fat_used_map_init (void) {
+	if (fat_fs->used_map != NULL)
+		bitmap_destroy (fat_fs->used_map);
+	if (fat_fs->dirty_map != NULL)
+		bitmap_destroy (fat_fs->dirty_map);
+	fat_fs->used_map = bitmap_create (fat_fs->fat_length);
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->used_map == NULL || fat_fs->dirty_map == NULL)
+		PANIC ("FAT bitmap creation failed");
+	bitmap_mark (fat_fs->used_map, 0);
+	for (cluster_t clst = 1; clst < fat_fs->fat_length; clst++)
+		if (fat_fs->fat[clst] != 0)
+			bitmap_mark (fat_fs->used_map, clst);
 }
 
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
 
+/* Finds CNT free consecutive clusters, first right behind HINT if it
+ * is not 0, then next fit from last_clst, wrapping around once.
+ * Returns the first of them, or 0 if there is no such run. */
+static cluster_t
+fat_find_free (cluster_t hint, size_t cnt) {
+	size_t clst;
+
+	if (hint != 0 && hint + cnt <= fat_fs->fat_length
+			&& bitmap_none (fat_fs->used_map, hint, cnt))
+		return hint;
+	clst = bitmap_scan (fat_fs->used_map, fat_fs->last_clst, cnt, false);
+	if (clst == BITMAP_ERROR)
+		clst = bitmap_scan (fat_fs->used_map, 1, cnt, false);
+	if (clst == BITMAP_ERROR)
+		return 0;
+	fat_fs->last_clst = clst + cnt < fat_fs->fat_length ? clst + cnt : 1;
+	return clst;
+}
+
 /* Add a cluster to the chain.
  * If CLST is 0, start a new chain.
  * Returns 0 if fails to allocate a new cluster. */
 cluster_t
 fat_create_chain (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	return fat_create_run (clst, 1);
+}
+
+/* fat_remove_chain(), with write_lock held. */
+static void
+remove_chain (cluster_t clst, cluster_t pclst) {
+	if (pclst != 0)
+		fat_put (pclst, EOChain);
+	while (clst != 0 && clst != EOChain) {
+		cluster_t next = fat_get (clst);
+
+		fat_put (clst, 0);
+		clst = next;
+	}
+}
+
+/* Adds CNT clusters to the chain after CLST, or starts a new chain of
+ * CNT clusters if CLST is 0.  The clusters are taken as one run right
+ * behind CLST or elsewhere, and only cut into shorter runs if no run
+ * of CNT clusters is free, so that a growing file stays contiguous.
+ * Returns the first new cluster, or 0 without changing the FAT if
+ * there are not CNT free clusters. */
+cluster_t
+fat_create_run (cluster_t clst, size_t cnt) {
+	cluster_t first = 0, prev = clst;
+	size_t run = cnt;
+
+	ASSERT (cnt > 0);
+	lock_acquire (&fat_fs->write_lock);
+	while (cnt > 0) {
+		cluster_t start = 0;
+
+		for (; run > 0; run /= 2)
+			if ((start = fat_find_free (prev != 0 ? prev + 1 : 0, run)) != 0)
+				break;
+		if (start == 0) {
+			/* Out of space: undo what this call allocated. */
+			if (first != 0)
+				remove_chain (first, clst);
+			lock_release (&fat_fs->write_lock);
+			return 0;
+		}
+		for (size_t i = 0; i < run; i++) {
+			fat_put (start + i, EOChain);
+			if (prev != 0)
+				fat_put (prev, start + i);
+			prev = start + i;
+		}
+		if (first == 0)
+			first = start;
+		cnt -= run;
+		if (run > cnt)
+			run = cnt;
+	}
+	lock_release (&fat_fs->write_lock);
+	return first;
 }
 
 /* Remove the chain of clusters starting from CLST.
  * If PCLST is 0, assume CLST as the start of the chain. */
 void
 fat_remove_chain (cluster_t clst, cluster_t pclst) {
-	/* TODO: Your code goes here. */
+	lock_acquire (&fat_fs->write_lock);
+	remove_chain (clst, pclst);
+	lock_release (&fat_fs->write_lock);
 }
 
 /* Update a value in the FAT table. */
 void
 fat_put (cluster_t clst, cluster_t val) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	fat_fs->fat[clst] = val;
+	bitmap_set (fat_fs->used_map, clst, val != 0);
+	bitmap_mark (fat_fs->dirty_map,
+			clst * sizeof (cluster_t) / DISK_SECTOR_SIZE);
 }
 
 /* Fetch a value in the FAT table. */
 cluster_t
 fat_get (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->fat[clst];
+}
+
+/* Returns the IDX'th cluster of the chain that starts at START, or 0
+ * if the chain is shorter.  POS remembers the last cluster found, and
+ * the walk starts there unless IDX lies before it, so reading a file
+ * forward costs one FAT lookup per cluster instead of a walk from the
+ * head.  A POS with CLST 0 is empty; callers empty it when they cut
+ * the chain. */
+cluster_t
+fat_seek (cluster_t start, size_t idx, struct fat_pos *pos) {
+	cluster_t clst = start;
+	size_t i = 0;
+
+	if (pos->clst != 0 && pos->idx <= idx) {
+		clst = pos->clst;
+		i = pos->idx;
+	}
+	for (; i < idx && clst != 0 && clst != EOChain; i++)
+		clst = fat_get (clst);
+	if (clst == 0 || clst == EOChain)
+		return 0;
+	pos->clst = clst;
+	pos->idx = idx;
+	return clst;
 }
 
 /* Covert a cluster # to a sector number. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
-	/* TODO: Your code goes here. */
+	ASSERT (clst > 0 && clst < fat_fs->fat_length);
+	return fat_fs->data_start + (clst - 1) * SECTORS_PER_CLUSTER;
 }
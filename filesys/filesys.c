@@ -6,11 +6,21 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/dcache.h"
+#include "filesys/journal.h"
 #include "devices/disk.h"
 #include "threads/synch.h"
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
+/* Write statistics. */
+long long filesys_data_bytes;
+long long filesys_meta_bytes;
+
+/* The root directory's inode, kept open so that dir_open_root() finds
+ * it in memory. */
+static struct inode *root_inode;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -22,6 +32,7 @@ filesys_init (bool format) {
 		PANIC ("hd0:1 (hdb) not present, file system initialization failed");
 
 	inode_init ();
+	dcache_init ();
 
 #ifdef EFILESYS
 	fat_init ();
@@ -37,38 +48,65 @@ filesys_init (bool format) {
 	if (format)
 		do_format ();
 
+	journal_open ();
 	free_map_open ();
 #endif
 
+	root_inode = inode_open (ROOT_DIR_SECTOR);
 }
 
 /* Shuts down the file system module, writing any unwritten data
  * to disk. */
 void
 filesys_done (void) {
+	inode_close (root_inode);
+
 	/* Original FS */
 #ifdef EFILESYS
 	fat_close ();
 #else
 	free_map_close ();
+	journal_close ();
 #endif
 }
 
+/* Prints write statistics: metadata bytes written per data byte, in
+ * hundredths. */
+void
+filesys_print_stats (void) {
+	long long ratio = filesys_data_bytes > 0
+		? filesys_meta_bytes * 100 / filesys_data_bytes : 0;
+
+	printf ("Filesys: %lld data bytes, %lld metadata bytes written, "
+			"%lld.%02lld metadata bytes per data byte\n",
+			filesys_data_bytes, filesys_meta_bytes, ratio / 100, ratio % 100);
+	dcache_print_stats ();
+	journal_print_stats ();
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
  * Returns true if successful, false otherwise.
  * Fails if a file named NAME already exists,
- * or if internal memory allocation fails. */
+ * or if internal memory allocation fails.
+ * The new inode, its directory entry and the free map reach the disk
+ * together, or not at all. */
 bool
 filesys_create (const char *name, off_t initial_size) {
 	disk_sector_t inode_sector = 0;
-	struct dir *dir = dir_open_root ();
-	bool success = (dir != NULL
+	struct dir *dir;
+	bool success;
+
+	journal_begin ();
+	dir = dir_open_root ();
+	success = (dir != NULL
 			&& free_map_allocate (1, &inode_sector)
 			&& inode_create (inode_sector, initial_size)
 			&& dir_add (dir, name, inode_sector));
 	if (!success && inode_sector != 0)
 		free_map_release (inode_sector, 1);
 	dir_close (dir);
+	free_map_flush ();
+	journal_end ();
 	return success;
 }
 
@@ -95,9 +133,14 @@ filesys_open (const char *name) {
  * or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) {
-	struct dir *dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	struct dir *dir;
+	bool success;
+
+	journal_begin ();
+	dir = dir_open_root ();
+	success = dir != NULL && dir_remove (dir, name);
 	dir_close (dir);
+	journal_end ();
 
 	return success;
 }
@@ -116,6 +159,7 @@ do_format (void) {
 	if (!dir_create (ROOT_DIR_SECTOR, 16))
 		PANIC ("root directory creation failed");
 	free_map_close ();
+	journal_create ();
 #endif
 
 	printf ("done.\n");
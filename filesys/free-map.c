@@ -1,47 +1,174 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static struct bitmap *alloc_map;     /* FREE_MAP plus the freed sectors the
+                                        journal does not let go yet. */
+static struct bitmap *dirty_map;     /* Sectors of the free map file that
+                                        differ from the disk. */
+static size_t free_cnt;              /* Sectors free in ALLOC_MAP. */
+static size_t reserved_cnt;          /* Of those, sectors reserved. */
+static struct lock free_map_lock;    /* Guards the maps and counts. */
+
+/* Free map bits in one sector of the free map file. */
+#define BITS_PER_SECTOR (DISK_SECTOR_SIZE * 8)
+
+/* Marks the sectors of the free map file that hold the bits of the
+ * CNT sectors at SECTOR as changed. */
+static void
+free_map_mark_dirty (disk_sector_t sector, size_t cnt) {
+	size_t first = sector / BITS_PER_SECTOR;
+	size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+	bitmap_set_multiple (dirty_map, first, last - first + 1, true);
+}
+
+/* Makes ALLOC_MAP a copy of FREE_MAP. */
+static void
+alloc_map_sync (void) {
+	for (size_t i = 0; i < bitmap_size (free_map); i++)
+		bitmap_set (alloc_map, i, bitmap_test (free_map, i));
+	free_cnt = bitmap_count (alloc_map, 0, bitmap_size (alloc_map), false);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) {
 	free_map = bitmap_create (disk_size (filesys_disk));
-	if (free_map == NULL)
+	alloc_map = bitmap_create (disk_size (filesys_disk));
+	if (free_map == NULL || alloc_map == NULL)
 		PANIC ("bitmap creation failed--disk is too large");
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS + 1, true);
+	alloc_map_sync ();
+	lock_init (&free_map_lock);
+	dirty_map = bitmap_create (DIV_ROUND_UP (bitmap_size (free_map),
+				BITS_PER_SECTOR));
+	if (dirty_map == NULL)
+		PANIC ("bitmap creation failed--disk is too large");
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
- * the first into *SECTORP.
+ * the first into *SECTORP.  The change reaches the disk with the next
+ * free_map_flush().  Sectors reserved with free_map_reserve() are not
+ * taken.
  * Returns true if successful, false if all sectors were
  * available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) {
-	disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-			&& free_map_file != NULL
-			&& !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
-	}
-	if (sector != BITMAP_ERROR)
+	disk_sector_t sector = BITMAP_ERROR;
+
+	lock_acquire (&free_map_lock);
+	if (free_cnt >= reserved_cnt + cnt)
+		sector = bitmap_scan_and_flip (alloc_map, 0, cnt, false);
+	if (sector != BITMAP_ERROR) {
+		free_cnt -= cnt;
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		free_map_mark_dirty (sector, cnt);
 		*sectorp = sector;
+	}
+	lock_release (&free_map_lock);
 	return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates the CNT sectors starting at SECTOR, if all of them are
+ * free.  Used to grow a file in place at the end of its last run.
+ * Returns true if successful, false otherwise. */
+bool
+free_map_allocate_at (disk_sector_t sector, size_t cnt) {
+	bool success = false;
+
+	lock_acquire (&free_map_lock);
+	if (sector + cnt <= bitmap_size (free_map)
+			&& free_cnt >= reserved_cnt + cnt
+			&& bitmap_none (alloc_map, sector, cnt)) {
+		free_cnt -= cnt;
+		bitmap_set_multiple (alloc_map, sector, cnt, true);
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		free_map_mark_dirty (sector, cnt);
+		success = true;
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use.  While the
+ * journal is open, they become available only when the journal calls
+ * free_map_reuse(), once their release can no longer be lost. */
 void
 free_map_release (disk_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	free_map_mark_dirty (sector, cnt);
+	for (size_t i = 0; i < cnt; i++)
+		if (!journal_forget (sector + i)) {
+			bitmap_reset (alloc_map, sector + i);
+			free_cnt++;
+		}
+	lock_release (&free_map_lock);
+}
+
+/* Makes SECTOR, released before, available for use again. */
+void
+free_map_reuse (disk_sector_t sector) {
+	lock_acquire (&free_map_lock);
+	ASSERT (!bitmap_test (free_map, sector));
+	bitmap_reset (alloc_map, sector);
+	free_cnt++;
+	lock_release (&free_map_lock);
+}
+
+/* Reserves CNT free sectors, to be allocated later, so that nobody
+ * else allocates them.  Returns true if successful, false if fewer
+ * than CNT sectors are free. */
+bool
+free_map_reserve (size_t cnt) {
+	bool success;
+
+	lock_acquire (&free_map_lock);
+	success = free_cnt >= reserved_cnt + cnt;
+	if (success)
+		reserved_cnt += cnt;
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Gives back CNT sectors reserved with free_map_reserve(), before
+ * allocating them or instead of it. */
+void
+free_map_unreserve (size_t cnt) {
+	lock_acquire (&free_map_lock);
+	ASSERT (reserved_cnt >= cnt);
+	reserved_cnt -= cnt;
+	lock_release (&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that changed since the last
+ * flush, and only those. */
+void
+free_map_flush (void) {
+	size_t idx = 0;
+
+	lock_acquire (&free_map_lock);
+	if (free_map_file != NULL) {
+		while ((idx = bitmap_scan (dirty_map, idx, 1, true)) != BITMAP_ERROR) {
+			bitmap_reset (dirty_map, idx);
+			bitmap_write_part (free_map, free_map_file, idx * DISK_SECTOR_SIZE,
+					DISK_SECTOR_SIZE);
+			idx++;
+		}
+	}
+	lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -50,14 +177,18 @@ free_map_open (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_meta (file_get_inode (free_map_file));
 	if (!bitmap_read (free_map, free_map_file))
 		PANIC ("can't read free map");
+	alloc_map_sync ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void) {
+	free_map_flush ();
 	file_close (free_map_file);
+	free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,6 +203,8 @@ free_map_create (void) {
 	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
 	if (free_map_file == NULL)
 		PANIC ("can't open free map");
+	inode_set_meta (file_get_inode (free_map_file));
 	if (!bitmap_write (free_map, free_map_file))
 		PANIC ("can't write free map");
+	bitmap_set_all (dirty_map, false);
 }
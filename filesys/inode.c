@@ -3,20 +3,72 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/fat.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A run of CNT consecutive disk sectors, starting at START, that holds
+ * consecutive sectors of a file. */
+struct extent {
+	disk_sector_t start;                /* First sector of the run. */
+	uint32_t cnt;                       /* Number of sectors. */
+};
+
+/* START of an extent that is a hole: its sectors have no disk space
+ * and read as zeros.  Sector 0 holds the free map's inode, never file
+ * data. */
+#define HOLE 0
+
+/* Extents kept in the inode itself, and in its indirect block. */
+#define DIRECT_EXTENTS 60
+#define INDIRECT_EXTENTS (DISK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (DIRECT_EXTENTS + INDIRECT_EXTENTS)
+
+/* Most sectors a file keeps in memory past its allocated ones.
+ * Sectors written past the end of a file are only reserved; they get
+ * disk space when written back, all at once, at the last close or
+ * when this many are waiting.  So a file written in small appends
+ * still takes few, long runs. */
+#define DELAY_MAX 64
+
+/* Most sectors a growing metadata file allocates ahead of its length.
+ * Metadata is not delayed, so it grows by as many sectors as it has,
+ * up to this, and a directory that grows an entry at a time still
+ * takes few, long runs.  What is left unused is given back when the
+ * file is closed. */
+#define GROW_MAX 64
+
+/* Most bytes a file holds inline, in the space of its direct extents,
+ * so that its content comes with its inode. */
+#define INLINE_MAX (DIRECT_EXTENTS * sizeof (struct extent))
+
+/* Bits of inode_disk's FLAGS. */
+#define INODE_INLINE 0x1                /* Content is in INLINE_DATA. */
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t extent_cnt;                /* Extents in use. */
+	disk_sector_t indirect;             /* Block of further extents, or 0. */
+	uint32_t start;                     /* First cluster, with EFILESYS. */
+	uint32_t flags;                     /* INODE_* bits. */
+	union {
+		struct extent extents[DIRECT_EXTENTS]; /* First extents, in file
+		                                          order. */
+		uint8_t inline_data[INLINE_MAX];   /* Content, if INODE_INLINE;
+		                                      zeros past LENGTH. */
+	};
+	disk_sector_t index;                /* Hashed directory index, or 0. */
+	uint32_t unused;                    /* Not used. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,37 +78,522 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.  OPEN_CNT and ELEM are guarded by
+ * open_inodes_lock.  RW is held for reading to read or write the
+ * sectors the inode has, and for writing to change its length,
+ * extents, delayed sectors or inline content.  DIR_LOCK serializes the
+ * directory operations on it. */
 struct inode {
 	struct list_elem elem;              /* Element in inode list. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool dirty;                         /* DATA or INDIRECT not on disk. */
+	bool meta;                          /* Content goes through the journal. */
+	size_t sector_cnt;                  /* Sectors in all extents. */
+	struct extent *indirect;            /* Content of DATA.indirect, or NULL. */
+	uint8_t **delayed;                  /* Sectors past SECTOR_CNT, not yet
+	                                       allocated, or NULL. */
+	size_t delayed_cnt;                 /* Number of delayed sectors. */
+#ifdef EFILESYS
+	struct fat_pos pos;                 /* Cluster looked up last. */
+#endif
 	struct inode_disk data;             /* Inode content. */
+	struct rwlock rw;                   /* Guards the layout of DATA. */
+	struct lock dir_lock;               /* Held by directory operations. */
 };
 
+/* Returns true if INODE holds its content inline. */
+static inline bool
+is_inline (const struct inode *inode) {
+	return inode->data.flags & INODE_INLINE;
+}
+
+#ifndef EFILESYS
+/* Returns the IDX'th extent of INODE. */
+static struct extent *
+extent_at (const struct inode *inode, size_t idx) {
+	ASSERT (idx < inode->data.extent_cnt);
+	if (idx < DIRECT_EXTENTS)
+		return (struct extent *) &inode->data.extents[idx];
+	return &inode->indirect[idx - DIRECT_EXTENTS];
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
- * INODE.
+ * INODE, or HOLE if that byte is in a hole.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
+	size_t idx = pos / DISK_SECTOR_SIZE;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos < 0 || idx >= inode->sector_cnt)
 		return -1;
+#ifdef EFILESYS
+	/* Readers share INODE, so each seeks from a copy of the cached
+	 * position, taken and put back whole. */
+	struct fat_pos cached;
+	enum intr_level old_level = intr_disable ();
+	cached = inode->pos;
+	intr_set_level (old_level);
+
+	cluster_t clst = fat_seek (inode->data.start, idx, &cached);
+
+	old_level = intr_disable ();
+	inode->pos = cached;
+	intr_set_level (old_level);
+	return cluster_to_sector (clst);
+#else
+	for (size_t i = 0; i < inode->data.extent_cnt; i++) {
+		const struct extent *e = extent_at (inode, i);
+
+		if (idx < e->cnt)
+			return e->start != HOLE ? e->start + idx : HOLE;
+		idx -= e->cnt;
+	}
+	NOT_REACHED ();
+#endif
+}
+
+#ifndef EFILESYS
+/* Makes room in INODE for CNT more extents.
+ * Returns false if INODE has no room for them. */
+static bool
+extent_room (struct inode *inode, size_t cnt) {
+	struct inode_disk *data = &inode->data;
+
+	if (data->extent_cnt + cnt > MAX_EXTENTS)
+		return false;
+	if (data->extent_cnt + cnt > DIRECT_EXTENTS) {
+		if (inode->indirect == NULL) {
+			inode->indirect = calloc (1, DISK_SECTOR_SIZE);
+			if (inode->indirect == NULL)
+				return false;
+		}
+		if (data->indirect == 0 && !free_map_allocate (1, &data->indirect))
+			return false;
+	}
+	return true;
+}
+
+/* Appends the run of CNT sectors at START, or a hole of CNT sectors if
+ * START is HOLE, to INODE, merging it into the last extent if it
+ * follows that one on disk or both are holes.
+ * Returns false if INODE has no room for another extent. */
+static bool
+extent_append (struct inode *inode, disk_sector_t start, size_t cnt) {
+	struct inode_disk *data = &inode->data;
+	struct extent *last = data->extent_cnt > 0
+		? extent_at (inode, data->extent_cnt - 1) : NULL;
+
+	if (last != NULL && (last->start == HOLE
+				? start == HOLE
+				: start != HOLE && last->start + last->cnt == start)) {
+		last->cnt += cnt;
+	} else {
+		if (!extent_room (inode, 1))
+			return false;
+		data->extent_cnt++;
+		last = extent_at (inode, data->extent_cnt - 1);
+		last->start = start;
+		last->cnt = cnt;
+	}
+	inode->sector_cnt += cnt;
+	inode->dirty = true;
+	return true;
+}
+
+/* Inserts an extent of CNT sectors at START before the IDX'th extent
+ * of INODE, which must have room for it.  The sectors of INODE stay
+ * as many as they were: the caller takes them from a hole. */
+static void
+extent_insert (struct inode *inode, size_t idx, disk_sector_t start,
+		size_t cnt) {
+	struct extent *e;
+
+	ASSERT (inode->data.extent_cnt < MAX_EXTENTS);
+	inode->data.extent_cnt++;
+	for (size_t i = inode->data.extent_cnt - 1; i > idx; i--)
+		*extent_at (inode, i) = *extent_at (inode, i - 1);
+	e = extent_at (inode, idx);
+	e->start = start;
+	e->cnt = cnt;
+	inode->dirty = true;
+}
+
+/* Gives disk space to up to CNT sectors of INODE from sector IDX on,
+ * which must be in a hole, and splits the hole around them.  When IDX
+ * starts the hole, the run is taken right behind the extent before it
+ * if it is free there, so that a hole filled in order stays contiguous
+ * with what precedes it.
+ * Returns the number of sectors filled, or 0 if the disk is full or
+ * INODE has no room for the extents of the split hole. */
+static size_t
+fill_hole (struct inode *inode, size_t idx, size_t cnt) {
+	struct extent *hole, *prev;
+	disk_sector_t start;
+	size_t i, ofs = idx, after;
+
+	for (i = 0; ofs >= extent_at (inode, i)->cnt; i++)
+		ofs -= extent_at (inode, i)->cnt;
+	hole = extent_at (inode, i);
+	ASSERT (hole->start == HOLE);
+	if (cnt > hole->cnt - ofs)
+		cnt = hole->cnt - ofs;
+
+	prev = i > 0 ? extent_at (inode, i - 1) : NULL;
+	if (ofs == 0 && prev != NULL && prev->start != HOLE
+			&& free_map_allocate_at (prev->start + prev->cnt, cnt)) {
+		prev->cnt += cnt;
+		hole->cnt -= cnt;
+		if (hole->cnt == 0) {
+			/* The hole is gone: close the gap it leaves. */
+			for (size_t j = i + 1; j < inode->data.extent_cnt; j++)
+				*extent_at (inode, j - 1) = *extent_at (inode, j);
+			inode->data.extent_cnt--;
+		}
+		inode->dirty = true;
+		return cnt;
+	}
+
+	/* A split in the middle needs two more extents, at an end one. */
+	for (; cnt > 0; cnt /= 2) {
+		after = hole->cnt - ofs - cnt;
+		if (!extent_room (inode, (ofs > 0) + (after > 0)))
+			return 0;
+		if (free_map_allocate (cnt, &start))
+			break;
+	}
+	if (cnt == 0)
+		return 0;
+
+	hole = extent_at (inode, i);
+	if (ofs == 0 && after == 0)
+		hole->start = start;
+	else if (ofs == 0) {
+		hole->cnt = after;
+		extent_insert (inode, i, start, cnt);
+	} else {
+		hole->cnt = ofs;
+		if (after > 0)
+			extent_insert (inode, i + 1, HOLE, after);
+		extent_insert (inode, i + 1, start, cnt);
+	}
+	inode->dirty = true;
+	return cnt;
+}
+#endif
+
+/* Returns true if any of the SIZE bytes of INODE at OFFSET is in a
+ * hole. */
+static bool
+has_hole (struct inode *inode UNUSED, off_t offset UNUSED,
+		off_t size UNUSED) {
+#ifdef EFILESYS
+	return false;
+#else
+	size_t first = offset / DISK_SECTOR_SIZE;
+	size_t end = DIV_ROUND_UP (offset + size, DISK_SECTOR_SIZE);
+	size_t pos = 0;
+
+	for (size_t i = 0; i < inode->data.extent_cnt && pos < end; i++) {
+		const struct extent *e = extent_at (inode, i);
+
+		if (e->start == HOLE && pos + e->cnt > first)
+			return true;
+		pos += e->cnt;
+	}
+	return false;
+#endif
+}
+
+/* Allocates sectors to INODE until it covers LENGTH bytes.  With
+ * PREALLOC, also allocates up to GROW_MAX sectors ahead.  A run is
+ * taken right behind the last extent when it is free there, and else
+ * as one new run, which is cut in halves only if the disk is too
+ * fragmented for it.
+ * Returns false if the disk is full or INODE has too many extents;
+ * the sectors allocated so far stay with INODE. */
+static bool
+inode_grow (struct inode *inode, off_t length, bool prealloc) {
+	size_t need_total = bytes_to_sectors (length);
+
+	while (inode->sector_cnt < need_total) {
+		size_t need = need_total - inode->sector_cnt;
+		size_t ahead = inode->sector_cnt < GROW_MAX ? inode->sector_cnt : GROW_MAX;
+		size_t want = prealloc && ahead > need ? ahead : need;
+#ifdef EFILESYS
+		/* fat_create_run() keeps the new clusters in one run after
+		 * the last one if it can. */
+		cluster_t last = inode->sector_cnt > 0
+			? fat_seek (inode->data.start, inode->sector_cnt - 1, &inode->pos)
+			: 0;
+		size_t cnt = want;
+		cluster_t first = fat_create_run (last, cnt);
+
+		if (first == 0 && want > need)
+			first = fat_create_run (last, cnt = need);
+		if (first == 0)
+			return false;
+		if (inode->data.start == 0)
+			inode->data.start = first;
+		inode->sector_cnt += cnt;
+		inode->dirty = true;
+#else
+		struct extent *last = inode->data.extent_cnt > 0
+			? extent_at (inode, inode->data.extent_cnt - 1) : NULL;
+		disk_sector_t start;
+		size_t cnt;
+
+		if (last != NULL && last->start != HOLE
+				&& free_map_allocate_at (last->start + last->cnt, want)) {
+			start = last->start + last->cnt;
+			cnt = want;
+		} else if (last != NULL && last->start != HOLE && want > need
+				&& free_map_allocate_at (last->start + last->cnt, need)) {
+			start = last->start + last->cnt;
+			cnt = need;
+		} else {
+			for (cnt = want; cnt > 0; cnt = cnt > need ? need : cnt / 2)
+				if (free_map_allocate (cnt, &start))
+					break;
+			if (cnt == 0)
+				return false;
+		}
+		if (!extent_append (inode, start, cnt)) {
+			free_map_release (start, cnt);
+			return false;
+		}
+#endif
+	}
+	return true;
+}
+
+/* Gives back the sectors of INODE past its length: what a growing
+ * metadata file allocated ahead, or everything if it was removed. */
+static void
+inode_trim (struct inode *inode) {
+	struct inode_disk *data = &inode->data;
+	size_t keep = inode->removed ? 0 : bytes_to_sectors (data->length);
+
+#ifdef EFILESYS
+	if (inode->sector_cnt > keep) {
+		if (keep == 0) {
+			fat_remove_chain (data->start, 0);
+			data->start = 0;
+		} else {
+			cluster_t last = fat_seek (data->start, keep - 1, &inode->pos);
+			fat_remove_chain (fat_get (last), last);
+		}
+		inode->sector_cnt = keep;
+		inode->pos.clst = 0;
+		inode->dirty = true;
+	}
+#else
+	while (inode->sector_cnt > keep) {
+		struct extent *last = extent_at (inode, data->extent_cnt - 1);
+		size_t cnt = inode->sector_cnt - keep;
+
+		if (cnt > last->cnt)
+			cnt = last->cnt;
+		if (last->start != HOLE)
+			free_map_release (last->start + last->cnt - cnt, cnt);
+		last->cnt -= cnt;
+		inode->sector_cnt -= cnt;
+		if (last->cnt == 0)
+			data->extent_cnt--;
+		inode->dirty = true;
+	}
+	if (data->extent_cnt <= DIRECT_EXTENTS && data->indirect != 0) {
+		free_map_release (data->indirect, 1);
+		data->indirect = 0;
+		inode->dirty = true;
+	}
+#endif
+}
+
+/* Reads SECTOR into BUFFER, from the journal if it holds a newer
+ * copy. */
+static void
+read_sector (disk_sector_t sector, void *buffer) {
+	if (!journal_read (sector, buffer))
+		disk_read (filesys_disk, sector, buffer);
+}
+
+/* Writes BUFFER to SECTOR of INODE's content: through the journal if
+ * INODE holds metadata, and else in place, ahead of the metadata that
+ * points to it. */
+static void
+write_sector (struct inode *inode, disk_sector_t sector, const void *buffer) {
+	if (inode->meta)
+		journal_write (sector, buffer);
+	else {
+		disk_write (filesys_disk, sector, buffer);
+		filesys_data_bytes += DISK_SECTOR_SIZE;
+	}
+}
+
+/* Reserves CNT sectors for delayed allocation, or gives them back.
+ * The FAT keeps no count of free clusters to reserve from. */
+static bool
+reserve (size_t cnt UNUSED) {
+#ifdef EFILESYS
+	return true;
+#else
+	return free_map_reserve (cnt);
+#endif
+}
+
+static void
+unreserve (size_t cnt UNUSED) {
+#ifndef EFILESYS
+	free_map_unreserve (cnt);
+#endif
+}
+
+/* Gives the delayed sectors of INODE disk space, as one run where the
+ * disk allows, and writes them.  The reservation is given back just
+ * before, so a thread allocating in between may take the space if the
+ * disk is that full; then INODE is cut to the sectors it got.
+ * Returns false in that case. */
+static bool
+inode_writeback (struct inode *inode) {
+	size_t first = inode->sector_cnt, cnt = inode->delayed_cnt;
+	bool success;
+
+	if (cnt == 0)
+		return true;
+	unreserve (cnt);
+	success = inode_grow (inode, (off_t) (first + cnt) * DISK_SECTOR_SIZE,
+			false);
+	for (size_t i = 0; i < cnt; i++) {
+		if (first + i < inode->sector_cnt)
+			write_sector (inode,
+					byte_to_sector (inode, (first + i) * DISK_SECTOR_SIZE),
+					inode->delayed[i]);
+		free (inode->delayed[i]);
+	}
+	inode->delayed_cnt = 0;
+	if (!success
+			&& inode->data.length > (off_t) inode->sector_cnt * DISK_SECTOR_SIZE) {
+		inode->data.length = inode->sector_cnt * DISK_SECTOR_SIZE;
+		inode->dirty = true;
+	}
+	return success;
+}
+
+/* Drops the delayed sectors of INODE, which was removed. */
+static void
+inode_discard (struct inode *inode) {
+	for (size_t i = 0; i < inode->delayed_cnt; i++)
+		free (inode->delayed[i]);
+	unreserve (inode->delayed_cnt);
+	inode->delayed_cnt = 0;
+}
+
+/* Makes INODE hold sectors, allocated or delayed, for LENGTH bytes.
+ * New sectors are delayed, up to DELAY_MAX of them; a larger extension
+ * writes the delayed ones back and allocates right away.  Metadata is
+ * always allocated right away, and ahead, so that the journal never
+ * commits a reference to a sector that has no place on disk.
+ * Returns false if the disk is full or memory runs out; INODE keeps
+ * what it got. */
+static bool
+inode_extend (struct inode *inode, off_t length) {
+	size_t need = bytes_to_sectors (length);
+	size_t cnt;
+
+	if (need <= inode->sector_cnt + inode->delayed_cnt)
+		return true;
+	if (inode->meta)
+		return inode_grow (inode, length, true);
+	if (need - inode->sector_cnt > DELAY_MAX) {
+		if (!inode_writeback (inode))
+			return false;
+		if (need - inode->sector_cnt > DELAY_MAX)
+			return inode_grow (inode, length, false);
+	}
+	if (inode->delayed == NULL) {
+		inode->delayed = calloc (DELAY_MAX, sizeof *inode->delayed);
+		if (inode->delayed == NULL)
+			return false;
+	}
+
+	cnt = need - inode->sector_cnt - inode->delayed_cnt;
+	if (!reserve (cnt))
+		return false;
+	for (; cnt > 0; cnt--) {
+		uint8_t *sector = calloc (1, DISK_SECTOR_SIZE);
+
+		if (sector == NULL) {
+			unreserve (cnt);
+			return false;
+		}
+		inode->delayed[inode->delayed_cnt++] = sector;
+	}
+	return true;
+}
+
+/* Writes INODE's on-disk inode and indirect block, if they changed. */
+static void
+inode_flush (struct inode *inode) {
+	if (!inode->dirty)
+		return;
+	journal_write (inode->sector, &inode->data);
+	if (inode->data.indirect != 0)
+		journal_write (inode->data.indirect, inode->indirect);
+	inode->dirty = false;
+}
+
+static off_t write_at (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset);
+
+/* Moves the inline content of INODE, which outgrows it, to sectors of
+ * its own.  Their space is taken, or reserved, before the content
+ * leaves the inode, so that a full disk leaves INODE as it was.
+ * Returns false in that case, or if memory runs out. */
+static bool
+inode_spill (struct inode *inode) {
+	off_t length = inode->data.length;
+	uint8_t *content = NULL;
+
+	if (length > 0) {
+		content = malloc (length);
+		if (content == NULL)
+			return false;
+		memcpy (content, inode->data.inline_data, length);
+	}
+	inode->data.flags &= ~INODE_INLINE;
+	memset (inode->data.inline_data, 0, INLINE_MAX);
+	inode->data.length = 0;
+	inode->dirty = true;
+	if (length > 0) {
+		if (!inode_extend (inode, length)) {
+			memcpy (inode->data.inline_data, content, length);
+			inode->data.flags |= INODE_INLINE;
+			inode->data.length = length;
+			free (content);
+			return false;
+		}
+		write_at (inode, content, length, 0);
+		free (content);
+	}
+	return true;
 }
 
 /* List of open inodes, so that opening a single inode twice
  * returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
 	list_init (&open_inodes);
+	lock_init (&open_inodes_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -66,32 +603,52 @@ inode_init (void) {
  * Returns false if memory or disk allocation fails. */
 bool
 inode_create (disk_sector_t sector, off_t length) {
-	struct inode_disk *disk_inode = NULL;
+	struct inode *inode;
 	bool success = false;
 
 	ASSERT (length >= 0);
 
 	/* If this assertion fails, the inode structure is not exactly
 	 * one sector in size, and you should fix that. */
-	ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
-
-	disk_inode = calloc (1, sizeof *disk_inode);
-	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
-		disk_inode->length = length;
-		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
+	ASSERT (sizeof (struct inode_disk) == DISK_SECTOR_SIZE);
+
+	inode = calloc (1, sizeof *inode);
+	if (inode != NULL) {
+		inode->sector = sector;
+		inode->data.length = length;
+		inode->data.magic = INODE_MAGIC;
+		if (length <= (off_t) INLINE_MAX) {
+			/* Small enough to live in the inode. */
+			inode->data.flags = INODE_INLINE;
+			success = true;
+#ifdef EFILESYS
+		} else if (inode_grow (inode, length, false)) {
+			/* A FAT chain has no holes: zero the clusters. */
+			static char zeros[DISK_SECTOR_SIZE];
+
+			for (cluster_t clst = inode->data.start;
+					clst != 0 && clst != EOChain; clst = fat_get (clst)) {
+				disk_write (filesys_disk, cluster_to_sector (clst), zeros);
+				filesys_data_bytes += DISK_SECTOR_SIZE;
 			}
-			success = true; 
-		} 
-		free (disk_inode);
+			success = true;
+		}
+#else
+		} else {
+			/* The file starts as one hole, so only its inode is
+			 * written. */
+			success = extent_append (inode, HOLE, bytes_to_sectors (length));
+		}
+#endif
+		if (success) {
+			inode->dirty = true;
+			inode_flush (inode);
+		} else {
+			inode->removed = true;
+			inode_trim (inode);
+		}
+		free (inode->indirect);
+		free (inode);
 	}
 	return success;
 }
@@ -104,36 +661,71 @@ inode_open (disk_sector_t sector) {
 	struct list_elem *e;
 	struct inode *inode;
 
-	/* Check whether this inode is already open. */
+	/* Check whether this inode is already open.  The lock is held
+	 * until a new inode is read, so that nobody opens it twice. */
+	lock_acquire (&open_inodes_lock);
 	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
 			e = list_next (e)) {
 		inode = list_entry (e, struct inode, elem);
 		if (inode->sector == sector) {
-			inode_reopen (inode);
+			inode->open_cnt++;
+			lock_release (&open_inodes_lock);
 			return inode; 
 		}
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof *inode);
-	if (inode == NULL)
+	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
+	}
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	inode->dirty = false;
+	inode->meta = false;
+	inode->indirect = NULL;
+	inode->delayed = NULL;
+	inode->delayed_cnt = 0;
+	rwlock_init (&inode->rw);
+	lock_init (&inode->dir_lock);
+	read_sector (inode->sector, &inode->data);
+	if (inode->data.indirect != 0) {
+		inode->indirect = malloc (DISK_SECTOR_SIZE);
+		if (inode->indirect == NULL) {
+			free (inode);
+			lock_release (&open_inodes_lock);
+			return NULL;
+		}
+		read_sector (inode->data.indirect, inode->indirect);
+	}
+	inode->sector_cnt = 0;
+#ifdef EFILESYS
+	inode->pos.clst = 0;
+	for (cluster_t clst = inode->data.start; clst != 0 && clst != EOChain;
+			clst = fat_get (clst))
+		inode->sector_cnt++;
+#else
+	for (size_t i = 0; i < inode->data.extent_cnt; i++)
+		inode->sector_cnt += extent_at (inode, i)->cnt;
+#endif
+	list_push_front (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -152,20 +744,53 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 
-	/* Release resources if this was the last opener. */
+	/* Release resources if this was the last opener.  The inode is
+	 * written back before the lock is released, so that a new opener
+	 * reads what it holds.  The inode, the sectors it frees and the
+	 * free map reach the disk in one journal group. */
+	journal_begin ();
+	lock_acquire (&open_inodes_lock);
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
+		bool is_free_map = inode->sector == FREE_MAP_SECTOR;
+		disk_sector_t index_sector = 0;
+
 		list_remove (&inode->elem);
 
-		/* Deallocate blocks if removed. */
+		/* Write the delayed sectors back, or drop them if removed.
+		 * Deallocate blocks if removed; a removed directory takes its
+		 * index along. */
+		if (inode->removed)
+			inode_discard (inode);
+		else
+			inode_writeback (inode);
+		inode_trim (inode);
 		if (inode->removed) {
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
-		}
+			index_sector = inode->data.index;
+		} else
+			inode_flush (inode);
+		lock_release (&open_inodes_lock);
 
+		free (inode->indirect);
+		free (inode->delayed);
 		free (inode); 
-	}
+
+		if (index_sector != 0) {
+			struct inode *index = inode_open (index_sector);
+
+			if (index != NULL) {
+				inode_remove (index);
+				inode_close (index);
+			}
+		}
+
+		/* The free map sectors changed with this file go to disk now,
+		 * together with its inode. */
+		if (!is_free_map)
+			free_map_flush ();
+	} else
+		lock_release (&open_inodes_lock);
+	journal_end ();
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -185,6 +810,17 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
 	
+	rwlock_acquire_read (&inode->rw);
+	if (is_inline (inode)) {
+		/* The content came with the inode. */
+		if (offset < inode_length (inode)) {
+			bytes_read = inode_length (inode) - offset;
+			if (bytes_read > size)
+				bytes_read = size;
+			memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+		}
+		size = 0;
+	}
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
@@ -200,9 +836,18 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
+		if ((size_t) offset / DISK_SECTOR_SIZE >= inode->sector_cnt) {
+			/* Delayed sector: read it from memory. */
+			size_t idx = offset / DISK_SECTOR_SIZE - inode->sector_cnt;
+
+			memcpy (buffer + bytes_read, inode->delayed[idx] + sector_ofs,
+					chunk_size);
+		} else if (sector_idx == HOLE) {
+			/* Hole: zeros, without reading the disk. */
+			memset (buffer + bytes_read, 0, chunk_size);
+		} else if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
+			read_sector (sector_idx, buffer + bytes_read);
 		} else {
 			/* Read sector into bounce buffer, then partially copy
 			 * into caller's buffer. */
@@ -211,7 +856,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 				if (bounce == NULL)
 					break;
 			}
-			disk_read (filesys_disk, sector_idx, bounce);
+			read_sector (sector_idx, bounce);
 			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
 		}
 
@@ -221,33 +866,80 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
+	rwlock_release_read (&inode->rw);
 	free (bounce);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
- * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+/* Does the work of inode_write_at(), with INODE's RW held for
+ * writing if the write extends it or INODE is inline, and for reading
+ * otherwise. */
+static off_t
+write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
+#ifdef EFILESYS
+	static const uint8_t zeros[DISK_SECTOR_SIZE];
+#endif
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
 	uint8_t *bounce = NULL;
+	size_t fresh_start = 0, fresh_end = 0;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	if (is_inline (inode)) {
+		/* The bytes of a gap are zeros already.  The inode reaches the
+		 * disk when it is flushed. */
+		if (size > 0 && offset + size <= (off_t) INLINE_MAX) {
+			memcpy (inode->data.inline_data + offset, buffer, size);
+			if (offset + size > inode->data.length)
+				inode->data.length = offset + size;
+			inode->dirty = true;
+			return size;
+		}
+		if (size > 0 && !inode_spill (inode))
+			return 0;
+	}
+
+#ifdef EFILESYS
+	/* Zero the gap, a sector at a time, each write starting at EOF. */
+	while (size > 0 && inode_length (inode) < offset) {
+		off_t pos = inode_length (inode);
+		off_t gap = offset - pos;
+		off_t chunk = DISK_SECTOR_SIZE - pos % DISK_SECTOR_SIZE;
+
+		if (write_at (inode, zeros, gap < chunk ? gap : chunk, pos) == 0)
+			return 0;
+	}
+#else
+	/* The whole sectors of the gap become a hole, after the delayed
+	 * sectors are written back.  The rest of the sector at EOF reads
+	 * as zeros already. */
+	if (size > 0 && inode_length (inode) < offset) {
+		size_t end = offset / DISK_SECTOR_SIZE;
+
+		if (!inode_writeback (inode)
+				|| (end > inode->sector_cnt
+					&& !extent_append (inode, HOLE, end - inode->sector_cnt)))
+			return 0;
+		inode->data.length = offset;
+		inode->dirty = true;
+	}
+#endif
+	if (size > 0 && offset + size > inode_length (inode))
+		inode_extend (inode, offset + size);
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		/* Bytes left in the allocated and delayed sectors, bytes left
+		 * in sector, lesser of the two. */
+		off_t inode_left = (off_t) (inode->sector_cnt + inode->delayed_cnt)
+			* DISK_SECTOR_SIZE - offset;
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -256,10 +948,33 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
+#ifndef EFILESYS
+		if (sector_idx == HOLE) {
+			/* Give disk space to the sectors of the hole that the rest
+			 * of the write covers.  They hold nothing to read back. */
+			size_t idx = offset / DISK_SECTOR_SIZE;
+			size_t cnt = fill_hole (inode, idx,
+					DIV_ROUND_UP (sector_ofs + size, DISK_SECTOR_SIZE));
+
+			if (cnt == 0)
+				break;
+			fresh_start = idx;
+			fresh_end = idx + cnt;
+			sector_idx = byte_to_sector (inode, offset);
+		}
+#endif
+		if ((size_t) offset / DISK_SECTOR_SIZE >= inode->sector_cnt) {
+			/* Delayed sector: write it in memory. */
+			size_t idx = offset / DISK_SECTOR_SIZE - inode->sector_cnt;
+
+			memcpy (inode->delayed[idx] + sector_ofs, buffer + bytes_written,
+					chunk_size);
+		} else if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
 			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
+			write_sector (inode, sector_idx, buffer + bytes_written);
 		} else {
+			size_t idx = offset / DISK_SECTOR_SIZE;
+
 			/* We need a bounce buffer. */
 			if (bounce == NULL) {
 				bounce = malloc (DISK_SECTOR_SIZE);
@@ -270,31 +985,82 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 			/* If the sector contains data before or after the chunk
 			   we're writing, then we need to read in the sector
 			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
+			if ((sector_ofs > 0 || chunk_size < sector_left)
+					&& offset - sector_ofs < inode_length (inode)
+					&& (idx < fresh_start || idx >= fresh_end))
+				read_sector (sector_idx, bounce);
 			else
 				memset (bounce, 0, DISK_SECTOR_SIZE);
 			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
+			write_sector (inode, sector_idx, bounce);
 		}
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
+		if (offset > inode->data.length) {
+			inode->data.length = offset;
+			inode->dirty = true;
+		}
 	}
 	free (bounce);
 
 	return bytes_written;
 }
 
-/* Disables writes to INODE.
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+ * Returns the number of bytes actually written, which may be
+ * less than SIZE if the disk is full or an error occurs.
+ * A write past end of file extends the inode; the bytes between the
+ * old end and OFFSET are a hole and read as zeros.  Writes within the
+ * allocated sectors of the file run alongside each other and
+ * alongside reads.  A write that extends the file or fills a hole is a
+ * journal operation, together with the free map sectors it
+ * allocates. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+		off_t offset) {
+	off_t bytes_written;
+
+	/* Within the file, holes only ever get filled, so a write that
+	 * finds none here needs no more than the read lock.  Inline content
+	 * changes the inode itself. */
+	rwlock_acquire_read (&inode->rw);
+	if (offset + size <= inode_length (inode) && !is_inline (inode)
+			&& !has_hole (inode, offset, size)) {
+		bytes_written = write_at (inode, buffer, size, offset);
+		rwlock_release_read (&inode->rw);
+		return bytes_written;
+	}
+	rwlock_release_read (&inode->rw);
+
+	journal_begin ();
+	rwlock_acquire_write (&inode->rw);
+	bytes_written = write_at (inode, buffer, size, offset);
+	/* Metadata that grew goes into the same journal group as its new
+	 * content, not at the last close, which the root directory never
+	 * sees. */
+	if (inode->meta)
+		inode_flush (inode);
+	rwlock_release_write (&inode->rw);
+	/* The free map, written by free_map_flush() itself, allocates
+	 * nothing. */
+	if (inode->sector != FREE_MAP_SECTOR)
+		free_map_flush ();
+	journal_end ();
+	return bytes_written;
+}
+
+/* Disables writes to INODE, after the writes in progress.
    May be called at most once per inode opener. */
 	void
 inode_deny_write (struct inode *inode) 
 {
+	rwlock_acquire_write (&inode->rw);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -302,9 +1068,51 @@ inode_deny_write (struct inode *inode)
  * inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode *inode) {
+	rwlock_acquire_write (&inode->rw);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	rwlock_release_write (&inode->rw);
+}
+
+/* Acquires the lock that serializes the directory operations on
+ * INODE. */
+void
+inode_lock_dir (struct inode *inode) {
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock taken by inode_lock_dir(). */
+void
+inode_unlock_dir (struct inode *inode) {
+	lock_release (&inode->dir_lock);
+}
+
+/* Returns the sector of the directory index of INODE, or 0. */
+disk_sector_t
+inode_get_index (const struct inode *inode) {
+	return inode->data.index;
+}
+
+/* Sets the sector of the directory index of INODE to INDEX.  The
+ * inode goes into the caller's journal group at once, with the release
+ * of the old index: left for the last close, which the root directory
+ * never sees, a replay would bring back a directory whose index is
+ * free space. */
+void
+inode_set_index (struct inode *inode, disk_sector_t index) {
+	rwlock_acquire_write (&inode->rw);
+	inode->data.index = index;
+	inode->dirty = true;
+	inode_flush (inode);
+	rwlock_release_write (&inode->rw);
+}
+
+/* Makes the content of INODE, a directory, directory index or the
+ * free map, go through the journal. */
+void
+inode_set_meta (struct inode *inode) {
+	inode->meta = true;
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -0,0 +1,502 @@
+/* journal.c: Write-ahead journal of file system metadata.
+ *
+ * Inode sectors, indirect blocks, the free map and directory blocks
+ * are not written in place.  journal_write() keeps the new content of
+ * such a sector in memory, and a group commit writes all sectors
+ * changed since the last one to the log in one sequential run: a
+ * descriptor naming the home sectors, the sectors themselves, and
+ * finally the journal header, whose single-sector write makes the
+ * group durable.  Sectors go home only at a checkpoint, when the log
+ * is full or the file system is unmounted, so that a sector changed
+ * by many groups is written home once.  journal_open() replays the
+ * groups in the log, in order, after a crash.
+ *
+ * A file system operation that changes several sectors runs between
+ * journal_begin() and journal_end(), and a group is only committed
+ * when no operation is running, so that it never holds half of one.
+ * A commit is due once GROUP_MAX sectors are waiting; new operations
+ * wait until it is done, and the last running operation does it.
+ * Otherwise journald commits every JOURNAL_INTERVAL ticks.
+ *
+ * The journal also hands out sectors for reading: until the
+ * checkpoint, the copy in memory is newer than the one at home.  For
+ * the same reason a metadata sector that is freed before it went home
+ * is not reused before the checkpoint.  Any other freed sector is not
+ * reused before the group that frees it commits: a crash before that
+ * brings back the file that had it, which must find its old content
+ * there.  See journal_forget(). */
+
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identifies the journal header and a descriptor. */
+#define JOURNAL_MAGIC 0x4c4e524a
+
+/* Sectors waiting that make a commit due. */
+#define GROUP_MAX 48
+
+/* Timer ticks between two commits by journald. */
+#define JOURNAL_INTERVAL 100
+
+/* Home sectors named by one descriptor. */
+#define DESC_MAX ((DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)) \
+		/ sizeof (disk_sector_t))
+
+/* On-disk journal header, at JOURNAL_SECTOR. */
+struct journal_header {
+	uint32_t magic;                     /* JOURNAL_MAGIC. */
+	uint32_t seq;                       /* Groups committed so far. */
+	uint32_t used;                      /* Log sectors to replay. */
+	uint8_t unused[DISK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+};
+
+/* On-disk descriptor, followed in the log by the CNT sectors it
+ * names. */
+struct journal_desc {
+	uint32_t magic;                     /* JOURNAL_MAGIC. */
+	uint32_t seq;                       /* Group it belongs to. */
+	uint32_t cnt;                       /* Sectors that follow. */
+	disk_sector_t sectors[DESC_MAX];    /* Their home sectors. */
+};
+
+/* A metadata sector held by the journal. */
+struct jblock {
+	struct hash_elem elem;              /* Element of blocks. */
+	struct list_elem list_elem;         /* Element of a checkpoint list. */
+	disk_sector_t sector;               /* Home sector. */
+	bool waiting;                       /* Changed since the last commit. */
+	bool freed;                         /* Released, not to go home. */
+	uint32_t log_pos;                   /* Log sector of the last committed
+	                                       copy + 1, or 0. */
+	uint8_t data[DISK_SECTOR_SIZE];     /* Newest content. */
+};
+
+/* A freed sector that may be reused after a commit or checkpoint. */
+struct freed_sector {
+	struct list_elem elem;
+	disk_sector_t sector;
+};
+
+bool journal_crash;
+bool journal_lose;
+
+static bool active;                     /* Opened and not closed. */
+static struct hash blocks;              /* All jblocks, by sector. */
+static struct lock journal_lock;        /* Guards everything here. */
+static struct condition committed;      /* Signaled after a commit. */
+static size_t waiting_cnt;              /* jblocks waiting for a commit. */
+static int op_cnt;                      /* Operations running. */
+static struct journal_header header;    /* Copy of the on-disk header. */
+static struct list freed;               /* Freed sectors, reusable. */
+static struct list pending;             /* Sectors freed by the group not
+                                           committed yet. */
+
+/* Statistics. */
+static long long journal_commits;
+static long long journal_logged;
+static long long journal_checkpoints;
+static long long journal_homed;
+
+static void journald (void *aux);
+
+static uint64_t
+jblock_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct jblock, elem)->sector);
+}
+
+static bool
+jblock_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct jblock, elem)->sector
+		< hash_entry (b, struct jblock, elem)->sector;
+}
+
+/* Returns the jblock of SECTOR, or NULL.  Must be called with
+ * journal_lock held. */
+static struct jblock *
+jblock_find (disk_sector_t sector) {
+	struct jblock key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&blocks, &key.elem);
+	return e != NULL ? hash_entry (e, struct jblock, elem) : NULL;
+}
+
+/* Returns the disk sector of log sector POS. */
+static disk_sector_t
+log_sector (uint32_t pos) {
+	return JOURNAL_SECTOR + 1 + pos;
+}
+
+/* Writes SECTOR from BUF and counts it as metadata. */
+static void
+meta_write (disk_sector_t sector, const void *buf) {
+	disk_write (filesys_disk, sector, buf);
+	filesys_meta_bytes += DISK_SECTOR_SIZE;
+}
+
+/* Writes every committed sector home and empties the log.  A sector
+ * waiting for a commit stays, but goes home as last committed, so that
+ * the home copy never runs ahead of the log.  Freed sectors are not
+ * written, and move to FREED.  Must be called with journal_lock
+ * held. */
+static void
+checkpoint (void) {
+	static uint8_t buf[DISK_SECTOR_SIZE];
+	struct hash_iterator i;
+	struct list done;
+
+	list_init (&done);
+	hash_first (&i, &blocks);
+	while (hash_next (&i)) {
+		struct jblock *b = hash_entry (hash_cur (&i), struct jblock, elem);
+
+		if (b->freed || !b->waiting)
+			list_push_back (&done, &b->list_elem);
+		if (b->freed)
+			continue;
+		if (!b->waiting)
+			meta_write (b->sector, b->data);
+		else if (b->log_pos != 0) {
+			disk_read (filesys_disk, log_sector (b->log_pos - 1), buf);
+			meta_write (b->sector, buf);
+		} else
+			continue;
+		b->log_pos = 0;
+		journal_homed++;
+	}
+
+	while (!list_empty (&done)) {
+		struct jblock *b = list_entry (list_pop_front (&done), struct jblock,
+				list_elem);
+		struct freed_sector *f;
+
+		hash_delete (&blocks, &b->elem);
+		if (b->freed && (f = malloc (sizeof *f)) != NULL) {
+			f->sector = b->sector;
+			list_push_back (&freed, &f->elem);
+		}
+		free (b);
+	}
+
+	header.used = 0;
+	meta_write (JOURNAL_SECTOR, &header);
+	journal_checkpoints++;
+}
+
+/* Writes the descriptor DESC and the CNT sectors of CHUNK to the log at
+ * *POS, and advances *POS. */
+static void
+log_chunk (struct journal_desc *desc, struct jblock **chunk, size_t cnt,
+		uint32_t *pos) {
+	desc->cnt = cnt;
+	for (size_t i = 0; i < cnt; i++)
+		desc->sectors[i] = chunk[i]->sector;
+	meta_write (log_sector ((*pos)++), desc);
+	for (size_t i = 0; i < cnt; i++) {
+		meta_write (log_sector (*pos), chunk[i]->data);
+		chunk[i]->log_pos = ++*pos;
+	}
+	journal_logged += cnt;
+}
+
+/* Makes the sectors freed by the groups committed so far reusable.
+ * Must be called with journal_lock held. */
+static void
+release_pending (void) {
+	while (!list_empty (&pending))
+		list_push_back (&freed, list_pop_front (&pending));
+}
+
+/* Writes the sectors waiting to the log as one group and commits it,
+ * checkpointing first if the log has no room.  Must be called with
+ * journal_lock held and no operation running. */
+static void
+commit (void) {
+	static struct journal_desc desc;
+	static struct jblock *chunk[DESC_MAX];
+	struct hash_iterator i;
+	size_t need, cnt = 0;
+	uint32_t pos;
+
+	ASSERT (op_cnt == 0);
+	if (waiting_cnt == 0) {
+		release_pending ();
+		return;
+	}
+
+	need = waiting_cnt + DIV_ROUND_UP (waiting_cnt, DESC_MAX);
+	if (header.used + need > JOURNAL_SECTORS)
+		checkpoint ();
+	if (need > JOURNAL_SECTORS)
+		PANIC ("journal group of %zu sectors does not fit", need);
+
+	pos = header.used;
+	desc.magic = JOURNAL_MAGIC;
+	desc.seq = header.seq;
+	hash_first (&i, &blocks);
+	while (hash_next (&i)) {
+		struct jblock *b = hash_entry (hash_cur (&i), struct jblock, elem);
+
+		if (!b->waiting)
+			continue;
+		chunk[cnt++] = b;
+		if (cnt == DESC_MAX) {
+			log_chunk (&desc, chunk, cnt, &pos);
+			cnt = 0;
+		}
+	}
+	if (cnt > 0)
+		log_chunk (&desc, chunk, cnt, &pos);
+
+	/* The commit point. */
+	header.seq++;
+	header.used = pos;
+	meta_write (JOURNAL_SECTOR, &header);
+
+	hash_first (&i, &blocks);
+	while (hash_next (&i))
+		hash_entry (hash_cur (&i), struct jblock, elem)->waiting = false;
+	waiting_cnt = 0;
+	release_pending ();
+	journal_commits++;
+	cond_broadcast (&committed, &journal_lock);
+}
+
+/* Hands the freed sectors that may be reused to the free map.  Must be
+ * called without journal_lock, since the free map calls back. */
+static void
+reuse_freed (void) {
+	for (;;) {
+		struct freed_sector *f = NULL;
+
+		lock_acquire (&journal_lock);
+		if (!list_empty (&freed))
+			f = list_entry (list_pop_front (&freed), struct freed_sector, elem);
+		lock_release (&journal_lock);
+		if (f == NULL)
+			break;
+		free_map_reuse (f->sector);
+		free (f);
+	}
+}
+
+/* Writes an empty journal while formatting. */
+void
+journal_create (void) {
+	memset (&header, 0, sizeof header);
+	header.magic = JOURNAL_MAGIC;
+	meta_write (JOURNAL_SECTOR, &header);
+}
+
+/* Replays the groups committed to the log since the last checkpoint,
+ * then starts journaling metadata writes. */
+void
+journal_open (void) {
+	static struct journal_desc desc;
+	static uint8_t buf[DISK_SECTOR_SIZE];
+	uint32_t pos = 0;
+
+	hash_init (&blocks, jblock_hash, jblock_less, NULL);
+	lock_init (&journal_lock);
+	cond_init (&committed);
+	list_init (&freed);
+	list_init (&pending);
+
+	disk_read (filesys_disk, JOURNAL_SECTOR, &header);
+	if (header.magic != JOURNAL_MAGIC)
+		PANIC ("file system has no journal");
+
+	while (pos < header.used) {
+		disk_read (filesys_disk, log_sector (pos++), &desc);
+		if (desc.magic != JOURNAL_MAGIC || desc.cnt > DESC_MAX)
+			PANIC ("journal descriptor at %"PRDSNu" is corrupt", log_sector (pos - 1));
+		for (uint32_t i = 0; i < desc.cnt; i++) {
+			disk_read (filesys_disk, log_sector (pos++), buf);
+			meta_write (desc.sectors[i], buf);
+		}
+	}
+	if (header.used > 0) {
+		header.used = 0;
+		meta_write (JOURNAL_SECTOR, &header);
+	}
+
+	active = true;
+	thread_create ("journald", PRI_DEFAULT, journald, NULL);
+}
+
+/* Commits what is waiting and, unless simulating a crash, writes
+ * everything home.  Metadata writes go straight to disk afterwards. */
+void
+journal_close (void) {
+	if (!active)
+		return;
+	lock_acquire (&journal_lock);
+	if (!journal_lose)
+		commit ();
+	if (!journal_crash)
+		checkpoint ();
+	active = false;
+	lock_release (&journal_lock);
+}
+
+static void
+journald (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (JOURNAL_INTERVAL);
+		lock_acquire (&journal_lock);
+		if (active && op_cnt == 0)
+			commit ();
+		lock_release (&journal_lock);
+		reuse_freed ();
+	}
+}
+
+/* Starts a file system operation whose metadata writes must reach the
+ * disk together.  Operations nest; only the outermost counts.  Must be
+ * called before taking any file system lock, since it may wait for a
+ * commit. */
+void
+journal_begin (void) {
+	struct thread *t = thread_current ();
+
+	if (t->journal_depth++ > 0 || !active)
+		return;
+	lock_acquire (&journal_lock);
+	while (waiting_cnt >= GROUP_MAX) {
+		if (op_cnt == 0)
+			commit ();
+		else
+			cond_wait (&committed, &journal_lock);
+	}
+	op_cnt++;
+	lock_release (&journal_lock);
+}
+
+/* Ends the operation started by journal_begin().  The last operation
+ * to end commits, if a commit is due, and wakes the operations waiting
+ * to begin either way. */
+void
+journal_end (void) {
+	struct thread *t = thread_current ();
+	bool committed_now = false;
+
+	ASSERT (t->journal_depth > 0);
+	if (--t->journal_depth > 0 || !active)
+		return;
+	lock_acquire (&journal_lock);
+	if (--op_cnt == 0) {
+		if (waiting_cnt >= GROUP_MAX) {
+			commit ();
+			committed_now = true;
+		}
+		cond_broadcast (&committed, &journal_lock);
+	}
+	lock_release (&journal_lock);
+	if (committed_now)
+		reuse_freed ();
+}
+
+/* Writes metadata sector SECTOR from BUF, through the journal.  The
+ * write is durable after the next commit. */
+void
+journal_write (disk_sector_t sector, const void *buf) {
+	struct jblock *b;
+
+	if (!active) {
+		meta_write (sector, buf);
+		return;
+	}
+
+	lock_acquire (&journal_lock);
+	b = jblock_find (sector);
+	if (b == NULL) {
+		b = malloc (sizeof *b);
+		if (b == NULL) {
+			/* Out of memory: write in place, unprotected. */
+			lock_release (&journal_lock);
+			meta_write (sector, buf);
+			return;
+		}
+		b->sector = sector;
+		b->waiting = false;
+		b->freed = false;
+		b->log_pos = 0;
+		hash_insert (&blocks, &b->elem);
+	}
+	ASSERT (!b->freed);
+	memcpy (b->data, buf, DISK_SECTOR_SIZE);
+	if (!b->waiting) {
+		b->waiting = true;
+		waiting_cnt++;
+	}
+	lock_release (&journal_lock);
+}
+
+/* Reads SECTOR into BUF if the journal holds a newer copy than its
+ * home.  Returns false, leaving BUF alone, if it does not. */
+bool
+journal_read (disk_sector_t sector, void *buf) {
+	struct jblock *b;
+
+	if (!active)
+		return false;
+	lock_acquire (&journal_lock);
+	b = jblock_find (sector);
+	if (b != NULL)
+		memcpy (buf, b->data, DISK_SECTOR_SIZE);
+	lock_release (&journal_lock);
+	return b != NULL;
+}
+
+/* Called when SECTOR is freed.  Returns true if SECTOR must not be
+ * reused yet; the journal hands it to free_map_reuse() later.  A
+ * sector the journal holds may still be written home on replay, so it
+ * waits for the next checkpoint.  Any other sector waits for the
+ * current group to commit. */
+bool
+journal_forget (disk_sector_t sector) {
+	struct jblock *b;
+	struct freed_sector *f = NULL;
+
+	if (!active)
+		return false;
+	lock_acquire (&journal_lock);
+	b = jblock_find (sector);
+	if (b != NULL) {
+		if (!b->freed) {
+			b->freed = true;
+			if (b->waiting) {
+				b->waiting = false;
+				waiting_cnt--;
+			}
+		}
+	} else if ((f = malloc (sizeof *f)) != NULL) {
+		f->sector = sector;
+		list_push_back (&pending, &f->elem);
+	}
+	lock_release (&journal_lock);
+
+	/* Out of memory, SECTOR is reused at once, unprotected. */
+	return b != NULL || f != NULL;
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) {
+	printf ("Journal: %lld commits, %lld sectors logged, "
+			"%lld checkpoints, %lld sectors written home\n",
+			journal_commits, journal_logged, journal_checkpoints, journal_homed);
+}
@@ -31,8 +31,20 @@ void fat_remove_chain (
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
+cluster_t fat_create_run (
+    cluster_t clst, /* Cluster # to stretch, 0: Create a new chain */
+    size_t cnt      /* Number of clusters to add */
+);
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
 disk_sector_t cluster_to_sector (cluster_t clst);
 
+/* Cached position in a cluster chain: CLST is the IDX'th cluster. */
+struct fat_pos {
+	cluster_t clst;
+	size_t idx;
+};
+
+cluster_t fat_seek (cluster_t start, size_t idx, struct fat_pos *pos);
+
 #endif /* filesys/fat.h */
@@ -7,12 +7,20 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header, followed by its log. */
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
+/* Bytes written to the file system disk for file data, and for
+ * metadata: inodes, directories, the free map, the FAT and the
+ * journal. */
+extern long long filesys_data_bytes;
+extern long long filesys_meta_bytes;
+
 void filesys_init (bool format);
 void filesys_done (void);
+void filesys_print_stats (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
@@ -18,6 +18,11 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
 off_t inode_length (const struct inode *);
+disk_sector_t inode_get_index (const struct inode *);
+void inode_set_index (struct inode *, disk_sector_t);
+void inode_set_meta (struct inode *);
 
 #endif /* filesys/inode.h */
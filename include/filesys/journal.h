@@ -0,0 +1,28 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/disk.h"
+
+/* Sectors of the journal's log, which follows the journal header at
+ * JOURNAL_SECTOR. */
+#define JOURNAL_SECTORS 256
+
+/* Simulate a crash at power off: commit, but skip the checkpoint.
+ * With JOURNAL_LOSE, skip the commit too. */
+extern bool journal_crash;
+extern bool journal_lose;
+
+void journal_create (void);
+void journal_open (void);
+void journal_close (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_write (disk_sector_t, const void *);
+bool journal_read (disk_sector_t, void *);
+bool journal_forget (disk_sector_t);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
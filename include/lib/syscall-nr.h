@@ -36,6 +36,13 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra */
+	SYS_SPAWN,                  /* Start a process from an executable. */
+	SYS_MSYNC,                  /* Write a memory mapping back. */
+	SYS_MADVISE,                /* Advise on the use of memory. */
+	SYS_BRK,                    /* Set the program break. */
+	SYS_SBRK,                   /* Move the program break. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -7,16 +7,34 @@
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Page invalidations in one pml4, deferred by the thread that set up
+ * the batch until tlb_batch_finish().  Up to TLB_BATCH_MAX pages are
+ * invalidated one by one, more take a single flush of the whole TLB. */
+#define TLB_BATCH_MAX 32
+struct tlb_batch {
+	uint64_t *pml4;
+	size_t cnt;                         /* Pages changed, may exceed MAX. */
+	uint64_t va[TLB_BATCH_MAX];
+	struct tlb_batch *outer;            /* Batch this one is nested in. */
+};
+
+void tlb_batch_begin (struct tlb_batch *, uint64_t *pml4);
+void tlb_batch_finish (struct tlb_batch *);
+void tlb_print_stats (void);
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
+uint64_t *pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_pcid_init (void);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
+void pml4_set_writable (uint64_t *pml4, const void *upage, bool writable);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
 
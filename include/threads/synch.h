@@ -40,6 +40,25 @@ void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 bool cmp_sem_priority(struct list_elem *e1, struct list_elem *e2);
 
+/* Readers-writer lock.  Many readers or one writer hold it at a
+ * time; a waiting writer keeps new readers out, so a reader must not
+ * acquire a lock it already holds. */
+struct rwlock {
+	struct lock lock;           /* Guards the members below. */
+	struct condition can_read;  /* Signaled when readers may enter. */
+	struct condition can_write; /* Signaled when a writer may enter. */
+	int readers;                /* Readers holding the lock. */
+	int writers_waiting;        /* Writers waiting for it. */
+	struct thread *writer;      /* Writer holding the lock, or NULL. */
+};
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -126,6 +126,7 @@ struct thread {
 	struct list_elem child_elem;
 	struct intr_frame parent_if;
 	struct semaphore fork_sema;
+	bool spawning;                      /* Parent waits for load(). */
 	struct semaphore free_sema;
 	struct semaphore wait_sema;
 
@@ -139,12 +140,21 @@ struct thread {
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	struct tlb_batch *tlb_batch;        /* Deferred TLB invalidations. */
+#endif
+#ifdef FILESYS
+	/* Owned by filesys/journal.c. */
+	int journal_depth;                  /* Nesting of journal_begin(). */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
 	void * stack_bottom;
 	void * user_rsp;
+	void * heap_start;                  /* First byte of the heap. */
+	void * heap_end;                    /* Program break. */
+	bool vm_io_unlock;                  /* Fault may release lock_vm. */
+	int vm_io_cnt;                      /* Own pages being evicted. */
 	// int open_file_cnt;
 	// unsigned int swap_cnt;
 	// struct bitmap *swap_table;
@@ -3,8 +3,21 @@
 
 #include "threads/thread.h"
 
+/* One fd redirection of spawn(): makes NEWFD a copy of OLDFD as dup2()
+ * does, or closes OLDFD if NEWFD is negative.  A list of actions ends
+ * with a negative OLDFD.  Same layout as in lib/user/syscall.h. */
+struct spawn_fd_action {
+	int oldfd;
+	int newfd;
+};
+
+/* Most actions a single spawn() accepts. */
+#define SPAWN_ACTIONS_MAX 16
+
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
+tid_t process_spawn (const char *cmd_line,
+		const struct spawn_fd_action *actions);
 int process_exec (void *f_name);
 int process_wait (tid_t);
 void process_exit (void);
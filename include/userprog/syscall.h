@@ -2,7 +2,9 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
-struct lock lock_read;
 
+/* Also used by process_spawn() to set up the child's fd table. */
+void close (int fd);
+int dup2 (int oldfd, int newfd);
 
 #endif /* userprog/syscall.h */
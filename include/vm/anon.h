@@ -1,18 +1,31 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
 #include "vm/vm.h"
+#include "vm/zswap.h"
 struct page;
+struct file_info;
 enum vm_type;
 
+/* File descriptor passed to mmap() for zero filled memory that is not
+ * backed by a file. */
+#define MAP_ANONYMOUS (-1)
+
 struct anon_page {
     vm_initializer *init;
     enum vm_type type;
     void *aux;
-    size_t bit_idx;
+    struct zswap_entry *swap;   /* Swapped out content, NULL if resident. */
+    bool dropped;               /* Freed by madvise(MADV_DONTNEED). */
     bool (*page_initializer) (struct page *, enum vm_type, void *kva);
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void *do_mmap_anon (void *addr, size_t length, int writable);
+void do_munmap_anon (void *addr, struct file_info *info);
+
+size_t swap_slot_write (const void *kva);
+void swap_slot_read (size_t slot, void *kva);
+void swap_slot_free (size_t slot);
 
 #endif
@@ -28,4 +28,8 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+int do_msync (void *addr, size_t length);
+void file_writeback_page (struct page *page);
+void file_writeback_unlocked (struct page *page, void *bounce);
+bool file_writeback_range (void *addr, void *end);
 #endif
@@ -0,0 +1,19 @@
+#ifndef VM_FILEMAP_H
+#define VM_FILEMAP_H
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct inode;
+
+void filemap_init (void);
+struct frame *filemap_get (struct inode *inode, off_t ofs, size_t len);
+void filemap_add (struct frame *frame, struct inode *inode, off_t ofs,
+		size_t len);
+void filemap_remove (struct frame *frame);
+off_t filemap_read (struct file *file, void *buffer, off_t size);
+off_t filemap_write (struct file *file, const void *buffer, off_t size);
+void filemap_print_stats (void);
+
+#endif
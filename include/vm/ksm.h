@@ -0,0 +1,15 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+#include <stdbool.h>
+
+struct frame;
+
+/* Set by the -ksm kernel command line option. */
+extern bool ksm_enabled;
+
+void ksm_init (void);
+void ksm_unshare (struct frame *frame);
+void ksm_print_stats (void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef VM_THP_H
+#define VM_THP_H
+#include <stdbool.h>
+
+struct page;
+
+/* Set by the -thp kernel command line option. */
+extern bool thp_enabled;
+
+bool thp_try_fault (struct page *page);
+void thp_print_stats (void);
+
+#endif
@@ -37,6 +37,22 @@ enum vm_type {
 struct page_operations;
 struct thread;
 
+/* Advice of madvise().  Same values as in lib/user/syscall.h. */
+enum vm_advice {
+	MADV_NORMAL = 0,        /* No special treatment. */
+	MADV_RANDOM = 1,        /* No readahead. */
+	MADV_SEQUENTIAL = 2,    /* Read ahead, drop pages behind. */
+	MADV_WILLNEED = 3,      /* Load the pages now. */
+	MADV_DONTNEED = 4,      /* Free the pages now. */
+};
+
+/* Frame replacement policies, chosen with -evict. */
+enum vm_evict_policy {
+	EVICT_CLOCK,            /* Second chance on the first page's bit. */
+	EVICT_2Q,               /* Hot and cold sets, clean frames first. */
+};
+extern enum vm_evict_policy vm_evict_policy;
+
 #define VM_TYPE(type) ((type) & 7)
 #define STACK_LIMIT (USER_STACK - 0x100000)
 /* The representation of "page".
@@ -52,6 +68,9 @@ struct page {
 	struct hash_elem hash_elem; /* Hash table elem */
 	bool not_present;
 	bool is_writable;
+	bool zero_mapped;      /* Read-only mapping of the shared zero frame */
+	struct thread *owner;  /* Thread whose page table maps this page */
+	uint8_t advice;        /* MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL */
 	struct list_elem copy_elem;
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -65,14 +84,22 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".  There is one for every page of the
+ * user pool, see vm_frame_of(). */
 struct frame {
 	void *kva;
 	struct page *page;
 	struct thread *thread;
 	struct list page_list;
-	struct list_elem list_e;
 	int write_protected;
+	bool allocated;        /* Taken from the user pool */
+	bool pinned;           /* Under I/O or being copied, never evicted */
+	bool hot;              /* In the hot set of the 2Q policy */
+	bool tested;           /* Went through one 2Q sweep since loaded */
+	bool spared;           /* Dirty, and passed over once by 2Q */
+	bool merged;           /* Shared by same-page merging, see vm/ksm.c */
+	uint64_t checksum;     /* Content hash of the last merging scan */
+	struct filemap_entry *cache; /* Entry in the file page cache, or NULL */
 };
 
 /* The function table for page operations.
@@ -109,6 +136,15 @@ bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
 void vm_init (void);
+void vm_print_stats (void);
+void vm_drop_page (struct page *page);
+struct frame *vm_frame_of (void *kva);
+void vm_free_frame (struct frame *frame);
+bool vm_frame_lock (void);
+void vm_frame_unlock (bool locked);
+int vm_madvise (void *addr, size_t length, int advice);
+void *vm_sbrk (intptr_t increment);
+bool vm_is_fresh_anon (struct page *page);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
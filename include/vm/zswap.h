@@ -0,0 +1,17 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+
+/* A page that has been swapped out.  It lives either as a flag (zero
+ * filled page), as a compressed copy in the kernel pool, or in a slot
+ * of the swap disk. */
+struct zswap_entry;
+
+void zswap_init (void);
+struct zswap_entry *zswap_store (const void *kva);
+bool zswap_load (struct zswap_entry *entry, void *kva);
+struct zswap_entry *zswap_dup (struct zswap_entry *entry);
+void zswap_free (struct zswap_entry *entry);
+void zswap_print_stats (void);
+
+#endif
@@ -326,6 +326,22 @@ bitmap_write (const struct bitmap *b, struct file *file) {
 	off_t size = byte_cnt (b->bit_cnt);
 	return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B at byte offset OFS to the same offset in
+   FILE, or fewer if B ends earlier.  Return true if successful,
+   false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file, size_t ofs,
+		size_t size) {
+	size_t total = byte_cnt (b->bit_cnt);
+
+	if (ofs >= total)
+		return true;
+	if (size > total - ofs)
+		size = total - ofs;
+	return file_write_at (file, (uint8_t *) b->bits + ofs, size, ofs)
+		== (off_t) size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,191 @@
+#include <malloc.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A simple user heap.
+
+   Small blocks come from the heap below the program break, which grows
+   through sbrk() in steps of at least HEAP_GROW bytes.  Free heap blocks
+   are kept on a single list sorted by address, allocation takes the
+   first block that fits and freed blocks are merged with their free
+   neighbors.
+
+   Blocks of MMAP_THRESHOLD bytes and more get their own anonymous
+   mapping instead, which free() hands back to the kernel with
+   munmap(). */
+
+/* Every block starts with this header.  Its size keeps the payload
+   aligned on ALIGNMENT bytes. */
+struct block {
+	size_t size;            /* Size including this header. */
+	struct block *next;     /* Next free block, or MAPPED. */
+};
+
+#define ALIGNMENT sizeof (struct block)
+#define PAGE_SIZE 4096
+#define HEAP_GROW (64 * 1024)
+#define MMAP_THRESHOLD (64 * 1024)
+
+/* Marks a block in use that owns an anonymous mapping. */
+#define MAPPED ((struct block *) 1)
+
+/* Free heap blocks, in address order. */
+static struct block *free_list;
+
+/* Puts B on the free list, merging it with adjacent free blocks. */
+static void
+insert_free (struct block *b) {
+	struct block *prev = NULL;
+	struct block *next = free_list;
+
+	while (next != NULL && next < b) {
+		prev = next;
+		next = next->next;
+	}
+
+	if (next != NULL && (char *) b + b->size == (char *) next) {
+		b->size += next->size;
+		b->next = next->next;
+	} else
+		b->next = next;
+
+	if (prev == NULL)
+		free_list = b;
+	else if ((char *) prev + prev->size == (char *) b) {
+		prev->size += b->size;
+		prev->next = b->next;
+	} else
+		prev->next = b;
+}
+
+/* Grows the heap by at least SIZE bytes.  Returns false if the kernel
+   refuses to move the break. */
+static bool
+grow_heap (size_t size) {
+	size_t grow = ROUND_UP (size < HEAP_GROW ? HEAP_GROW : size, PAGE_SIZE);
+	char *brk = sbrk (0);
+	size_t pad = ROUND_UP ((uintptr_t) brk, ALIGNMENT) - (uintptr_t) brk;
+	struct block *b;
+
+	if (brk == (void *) -1 || sbrk (pad + grow) == (void *) -1)
+		return false;
+	b = (struct block *) (brk + pad);
+	b->size = grow;
+	insert_free (b);
+	return true;
+}
+
+/* Takes SIZE bytes from the first free block that is large enough, or
+   returns NULL if there is none. */
+static struct block *
+first_fit (size_t size) {
+	struct block **bp;
+
+	for (bp = &free_list; *bp != NULL; bp = &(*bp)->next) {
+		struct block *b = *bp;
+
+		if (b->size < size)
+			continue;
+		if (b->size - size >= 2 * sizeof (struct block)) {
+			/* Split off the tail, so the free block stays in place. */
+			b->size -= size;
+			b = (struct block *) ((char *) b + b->size);
+			b->size = size;
+		} else
+			*bp = b->next;
+		b->next = NULL;
+		return b;
+	}
+	return NULL;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) {
+	struct block *b;
+
+	if (size == 0 || size > SIZE_MAX - PAGE_SIZE)
+		return NULL;
+	size = ROUND_UP (size + sizeof (struct block), ALIGNMENT);
+
+	if (size >= MMAP_THRESHOLD) {
+		size = ROUND_UP (size, PAGE_SIZE);
+		b = mmap (NULL, size, true, MAP_ANONYMOUS, 0);
+		if (b == MAP_FAILED)
+			return NULL;
+		b->size = size;
+		b->next = MAPPED;
+		return b + 1;
+	}
+
+	b = first_fit (size);
+	if (b == NULL && grow_heap (size))
+		b = first_fit (size);
+	return b != NULL ? b + 1 : NULL;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) {
+	void *p;
+	size_t size;
+
+	size = a * b;
+	if (size < a || size < b)
+		return NULL;
+
+	p = malloc (size);
+	if (p != NULL)
+		memset (p, 0, size);
+	return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving it
+   in the process.  If successful, returns the new block; on failure,
+   returns a null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) {
+	struct block *b;
+	size_t old_size;
+	void *new_block;
+
+	if (new_size == 0) {
+		free (old_block);
+		return NULL;
+	}
+	if (old_block == NULL)
+		return malloc (new_size);
+
+	b = (struct block *) old_block - 1;
+	old_size = b->size - sizeof (struct block);
+	if (new_size <= old_size)
+		return old_block;
+
+	new_block = malloc (new_size);
+	if (new_block != NULL) {
+		memcpy (new_block, old_block, old_size);
+		free (old_block);
+	}
+	return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) {
+	struct block *b;
+
+	if (p == NULL)
+		return;
+	b = (struct block *) p - 1;
+	if (b->next == MAPPED)
+		munmap (b);
+	else
+		insert_free (b);
+}
@@ -0,0 +1,44 @@
+/* Appends small chunks to two files in turn, so that each write
+   extends a file, and reads both back through a second descriptor
+   before and after they are closed. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 100
+#define CHUNK_CNT 120
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+
+static char buf[2][FILE_SIZE];
+static const char *names[2] = {"a", "b"};
+
+void
+test_main (void)
+{
+  int fd[2], i, j;
+
+  random_bytes (buf, sizeof buf);
+  for (j = 0; j < 2; j++)
+    {
+      CHECK (create (names[j], 0), "create \"%s\"", names[j]);
+      CHECK ((fd[j] = open (names[j])) > 1, "open \"%s\"", names[j]);
+    }
+
+  msg ("append %d chunks to each file", CHUNK_CNT);
+  for (i = 0; i < CHUNK_CNT; i++)
+    for (j = 0; j < 2; j++)
+      if (write (fd[j], buf[j] + i * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("append to \"%s\" failed", names[j]);
+
+  for (j = 0; j < 2; j++)
+    check_file (names[j], buf[j], FILE_SIZE);
+  for (j = 0; j < 2; j++)
+    {
+      msg ("close \"%s\"", names[j]);
+      close (fd[j]);
+    }
+  for (j = 0; j < 2; j++)
+    check_file (names[j], buf[j], FILE_SIZE);
+}
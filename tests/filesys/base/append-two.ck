@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(append-two) begin
+(append-two) create "a"
+(append-two) open "a"
+(append-two) create "b"
+(append-two) open "b"
+(append-two) append 120 chunks to each file
+(append-two) open "a" for verification
+(append-two) verified contents of "a"
+(append-two) close "a"
+(append-two) open "b" for verification
+(append-two) verified contents of "b"
+(append-two) close "b"
+(append-two) close "a"
+(append-two) close "b"
+(append-two) open "a" for verification
+(append-two) verified contents of "a"
+(append-two) close "a"
+(append-two) open "b" for verification
+(append-two) verified contents of "b"
+(append-two) close "b"
+(append-two) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Child process for syn-rw-many test.
+   Appends to a file of its own a chunk at a time, reading a chunk
+   of the shared file after each write.  Other processes do the
+   same at the same time. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/base/syn-rw-many.h"
+
+char shared[BUF_SIZE];
+char buf[BUF_SIZE];
+
+int
+main (int argc, char *argv[])
+{
+  char name[16];
+  char chunk[CHUNK_SIZE];
+  int child_idx;
+  int fd, shared_fd, i;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (shared, sizeof shared);
+  random_init (child_idx + 1);
+  random_bytes (buf, sizeof buf);
+
+  snprintf (name, sizeof name, "file%d", child_idx);
+  CHECK (create (name, 0), "create \"%s\"", name);
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  CHECK ((shared_fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  for (i = 0; i < CHUNK_CNT; i++)
+    {
+      int ofs = ((i + child_idx) % CHUNK_CNT) * CHUNK_SIZE;
+
+      if (write (fd, buf + i * CHUNK_SIZE, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write \"%s\" chunk %d failed", name, i);
+      seek (shared_fd, ofs);
+      if (read (shared_fd, chunk, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("read \"%s\" at %d failed", shared_name, ofs);
+      compare_bytes (chunk, shared + ofs, CHUNK_SIZE, ofs, shared_name);
+    }
+  close (shared_fd);
+  close (fd);
+
+  return child_idx;
+}
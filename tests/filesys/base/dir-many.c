@@ -0,0 +1,64 @@
+/* Creates 10,000 files in one directory, then opens and removes
+   them all.  With a hashed directory index, the disk reads per
+   create must not grow with the size of the directory; the linear
+   format needs hundreds per create by the end. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 10000
+
+/* Disk reads allowed per create, on average, over the last
+   1,000 creates. */
+#define READS_PER_CREATE 40
+
+static void
+make_name (char *name, int i)
+{
+  snprintf (name, 16, "f%d", i);
+}
+
+void
+test_main (void)
+{
+  long long read_cnt = 0;
+  char name[16];
+  int i;
+
+  msg ("creating %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      if (i == FILE_CNT - 1000)
+        read_cnt = get_fs_disk_read_cnt ();
+      make_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  CHECK (get_fs_disk_read_cnt () - read_cnt <= 1000 * READS_PER_CREATE,
+         "check read_cnt");
+
+  msg ("opening every 97th file");
+  for (i = 0; i < FILE_CNT; i += 97)
+    {
+      int fd;
+
+      make_name (name, i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  CHECK (open ("f10000") == -1, "open \"f10000\" (must fail)");
+  CHECK (!create ("f1234", 0), "create \"f1234\" again (must fail)");
+
+  msg ("removing %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  CHECK (open ("f0") == -1, "open \"f0\" (must fail)");
+  CHECK (create ("f0", 0), "create \"f0\"");
+}
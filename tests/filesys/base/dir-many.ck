@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) creating 10000 files
+(dir-many) check read_cnt
+(dir-many) opening every 97th file
+(dir-many) open "f10000" (must fail)
+(dir-many) create "f1234" again (must fail)
+(dir-many) removing 10000 files
+(dir-many) open "f0" (must fail)
+(dir-many) create "f0"
+(dir-many) end
+EOF
+pass;
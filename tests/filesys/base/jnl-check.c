@@ -0,0 +1,44 @@
+/* Run by the boot after jnl-crash: verifies that replaying the
+   journal brought back the files it left, and that the sectors of
+   the removed ones may be used again. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-crash.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char big[BIG_SIZE];
+static char zeros[BIG_SIZE];
+
+void
+test_main (void)
+{
+  char name[16];
+  int fd, i;
+
+  random_bytes (big, sizeof big);
+  check_file (big_name, big, BIG_SIZE);
+
+  msg ("check %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      fd = open (name);
+      if (i % 2 != 0)
+        {
+          if (fd != -1)
+            fail ("removed \"%s\" is back", name);
+          continue;
+        }
+      if (fd < 2)
+        fail ("open \"%s\" failed", name);
+      if (filesize (fd) != i * 100)
+        fail ("size of \"%s\" is %d, not %d", name, filesize (fd), i * 100);
+      close (fd);
+    }
+
+  CHECK (create ("new", BIG_SIZE), "create \"new\"");
+  check_file ("new", zeros, BIG_SIZE);
+}
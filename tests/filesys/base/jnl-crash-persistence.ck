@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-check) begin
+(jnl-check) open "big" for verification
+(jnl-check) verified contents of "big"
+(jnl-check) close "big"
+(jnl-check) check 80 files
+(jnl-check) create "new"
+(jnl-check) open "new" for verification
+(jnl-check) verified contents of "new"
+(jnl-check) close "new"
+(jnl-check) end
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Creates, grows and removes files, then powers off without writing
+   the journal home (-jcrash), so that all of it is left in the log.
+   jnl-check verifies the files after the next boot replays the
+   log. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-crash.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char big[BIG_SIZE];
+
+void
+test_main (void)
+{
+  char name[16];
+  int fd, i;
+
+  random_bytes (big, sizeof big);
+  CHECK (create (big_name, 0), "create \"%s\"", big_name);
+  CHECK ((fd = open (big_name)) > 1, "open \"%s\"", big_name);
+  CHECK (write (fd, big, BIG_SIZE / 2) == BIG_SIZE / 2,
+         "write first half of \"%s\"", big_name);
+  CHECK (write (fd, big + BIG_SIZE / 2, BIG_SIZE / 2) == BIG_SIZE / 2,
+         "grow \"%s\"", big_name);
+  msg ("close \"%s\"", big_name);
+  close (fd);
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, i * 100))
+        fail ("create \"%s\" failed", name);
+    }
+
+  msg ("remove odd files");
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+}
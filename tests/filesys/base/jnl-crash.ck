@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-crash) begin
+(jnl-crash) create "big"
+(jnl-crash) open "big"
+(jnl-crash) write first half of "big"
+(jnl-crash) grow "big"
+(jnl-crash) close "big"
+(jnl-crash) create 80 files
+(jnl-crash) remove odd files
+(jnl-crash) end
+EOF
+pass;
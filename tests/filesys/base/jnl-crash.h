@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_JNL_CRASH_H
+#define TESTS_FILESYS_BASE_JNL_CRASH_H
+
+#define FILE_CNT 80
+#define BIG_SIZE 20000
+static const char big_name[] = "big";
+
+#endif /* tests/filesys/base/jnl-crash.h */
@@ -0,0 +1,38 @@
+/* Run by the boot after jnl-index: the files that survived must be
+   the first ones created, at least "e0", whose group committed long
+   before the last one, and all of them must be found through the
+   root directory's index.  New files must go in, too. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-index.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char name[16];
+  int fd, i, cnt;
+
+  msg ("look up %d files", FILE_CNT);
+  for (cnt = 0; cnt < FILE_CNT; cnt++)
+    {
+      snprintf (name, sizeof name, "e%d", cnt);
+      if ((fd = open (name)) < 2)
+        break;
+      close (fd);
+    }
+  if (cnt == 0)
+    fail ("\"e0\" is gone");
+  for (i = cnt + 1; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "e%d", i);
+      if ((fd = open (name)) > 1)
+        fail ("\"e%d\" is there but \"e%d\" is not", i, cnt);
+    }
+
+  CHECK (create ("fresh", 0), "create \"fresh\"");
+  CHECK ((fd = open ("fresh")) > 1, "open \"fresh\"");
+  close (fd);
+}
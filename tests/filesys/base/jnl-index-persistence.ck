@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-index-check) begin
+(jnl-index-check) look up 300 files
+(jnl-index-check) create "fresh"
+(jnl-index-check) open "fresh"
+(jnl-index-check) end
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Creates FILE_CNT files in the root directory, enough for it to get
+   an index and then to trade that for a larger one, and powers off
+   without committing the last journal group (-jcrash=lose).
+   jnl-index-check verifies, after the next boot, that the replayed
+   root directory still finds its files. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-index.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char name[16];
+  int i;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "e%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_BASE_JNL_INDEX_H
+#define TESTS_FILESYS_BASE_JNL_INDEX_H
+
+/* Past the first index of the root directory, at 64 entries, and
+   past the point where it is built again, larger. */
+#define FILE_CNT 300
+
+#endif /* tests/filesys/base/jnl-index.h */
@@ -0,0 +1,44 @@
+/* Run by the boot after jnl-reuse: each of "old" and "new" may be
+   there or not, depending on how much of the journal committed, but
+   if it is there it must hold its own data. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-reuse.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char old_data[DATA_SIZE];
+static char new_data[DATA_SIZE];
+static char buf[DATA_SIZE];
+
+/* Fails if FILE_NAME exists and does not hold the DATA_SIZE bytes of
+   DATA. */
+static void
+check_if_there (const char *file_name, const char *data)
+{
+  int fd = open (file_name);
+
+  if (fd < 2)
+    return;
+  if (filesize (fd) != DATA_SIZE)
+    fail ("size of \"%s\" is %d, not %d", file_name, filesize (fd),
+          DATA_SIZE);
+  if (read (fd, buf, DATA_SIZE) != DATA_SIZE)
+    fail ("read \"%s\" failed", file_name);
+  if (memcmp (buf, data, DATA_SIZE))
+    fail ("\"%s\" lost its data", file_name);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  random_bytes (old_data, sizeof old_data);
+  random_bytes (new_data, sizeof new_data);
+
+  msg ("check \"old\" and \"new\"");
+  check_if_there ("old", old_data);
+  check_if_there ("new", new_data);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-reuse-check) begin
+(jnl-reuse-check) check "old" and "new"
+(jnl-reuse-check) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Writes "old" and lets its journal group commit, then removes it
+   and writes "new" of the same size, and powers off without
+   committing that group (-jcrash=lose).  jnl-reuse-check verifies,
+   after the next boot, that "old", which the replay brings back,
+   still holds its own data and not that of "new". */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/jnl-reuse.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char old_data[DATA_SIZE];
+static char new_data[DATA_SIZE];
+
+/* Creates FILE_NAME and writes the DATA_SIZE bytes of DATA to it. */
+static void
+write_file (const char *file_name, const char *data)
+{
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, data, DATA_SIZE) == DATA_SIZE,
+         "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  char name[16];
+  int i;
+
+  random_bytes (old_data, sizeof old_data);
+  random_bytes (new_data, sizeof new_data);
+  write_file ("old", old_data);
+
+  /* Enough new inodes to make a journal group commit. */
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "f%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+
+  CHECK (remove ("old"), "remove \"old\"");
+  write_file ("new", new_data);
+}
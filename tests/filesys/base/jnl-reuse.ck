@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(jnl-reuse) begin
+(jnl-reuse) create "old"
+(jnl-reuse) open "old"
+(jnl-reuse) write "old"
+(jnl-reuse) close "old"
+(jnl-reuse) create 64 files
+(jnl-reuse) remove "old"
+(jnl-reuse) create "new"
+(jnl-reuse) open "new"
+(jnl-reuse) write "new"
+(jnl-reuse) close "new"
+(jnl-reuse) end
+EOF
+pass;
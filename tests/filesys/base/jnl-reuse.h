@@ -0,0 +1,7 @@
+#ifndef TESTS_FILESYS_BASE_JNL_REUSE_H
+#define TESTS_FILESYS_BASE_JNL_REUSE_H
+
+#define FILE_CNT 64
+#define DATA_SIZE 8192
+
+#endif /* tests/filesys/base/jnl-reuse.h */
@@ -0,0 +1,40 @@
+/* Opens the same file, and a missing one, over and over.  With the
+   root directory's inode in memory and the names in the dentry
+   cache, none of these opens reads the disk. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 100
+
+void
+test_main (void)
+{
+  long long read_cnt;
+  int fd, i;
+
+  CHECK (create ("hot", 0), "create \"hot\"");
+  CHECK ((fd = open ("hot")) > 1, "open \"hot\"");
+  CHECK (open ("cold") == -1, "open \"cold\" (must fail)");
+
+  read_cnt = get_fs_disk_read_cnt ();
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      int fd2 = open ("hot");
+
+      if (fd2 < 2)
+        fail ("open \"hot\" failed");
+      close (fd2);
+      if (open ("cold") != -1)
+        fail ("open \"cold\" succeeded");
+    }
+  CHECK (get_fs_disk_read_cnt () == read_cnt, "check read_cnt");
+
+  CHECK (remove ("hot"), "remove \"hot\"");
+  CHECK (open ("hot") == -1, "open \"hot\" (must fail)");
+  CHECK (create ("cold", 0), "create \"cold\"");
+  CHECK ((i = open ("cold")) > 1, "open \"cold\"");
+  close (i);
+  close (fd);
+}
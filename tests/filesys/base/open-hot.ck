@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(open-hot) begin
+(open-hot) create "hot"
+(open-hot) open "hot"
+(open-hot) open "cold" (must fail)
+(open-hot) check read_cnt
+(open-hot) remove "hot"
+(open-hot) open "hot" (must fail)
+(open-hot) create "cold"
+(open-hot) open "cold"
+(open-hot) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Writes a file small enough to live in its inode, which must read
+   back without touching the disk, then grows it out of the inode and
+   checks that nothing is lost. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SMALL 100
+#define GROWN 1100
+
+static char data[GROWN];
+static char buf[GROWN];
+
+/* Reads the first SIZE bytes of FD and compares them with DATA. */
+static void
+check_content (int fd, size_t size)
+{
+  seek (fd, 0);
+  CHECK (read (fd, buf, size) == (int) size, "read %zu bytes", size);
+  if (memcmp (buf, data, size))
+    fail ("content differs");
+}
+
+void
+test_main (void)
+{
+  long long cnt;
+  int fd;
+
+  random_bytes (data, sizeof data);
+  CHECK (create ("tiny", 0), "create \"tiny\"");
+  CHECK ((fd = open ("tiny")) > 1, "open \"tiny\"");
+  CHECK (write (fd, data, SMALL) == SMALL, "write %d bytes", SMALL);
+  msg ("close \"tiny\"");
+  close (fd);
+
+  CHECK ((fd = open ("tiny")) > 1, "open \"tiny\"");
+  cnt = get_fs_disk_read_cnt ();
+  check_content (fd, SMALL);
+  CHECK (get_fs_disk_read_cnt () == cnt, "check read_cnt");
+
+  CHECK (write (fd, data + SMALL, GROWN - SMALL) == GROWN - SMALL,
+         "write %d bytes", GROWN - SMALL);
+  CHECK (filesize (fd) == GROWN, "check size");
+  check_content (fd, GROWN);
+  msg ("close \"tiny\"");
+  close (fd);
+
+  CHECK ((fd = open ("tiny")) > 1, "open \"tiny\"");
+  check_content (fd, GROWN);
+  msg ("close \"tiny\"");
+  close (fd);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-inline) begin
+(sm-inline) create "tiny"
+(sm-inline) open "tiny"
+(sm-inline) write 100 bytes
+(sm-inline) close "tiny"
+(sm-inline) open "tiny"
+(sm-inline) read 100 bytes
+(sm-inline) check read_cnt
+(sm-inline) write 1000 bytes
+(sm-inline) check size
+(sm-inline) read 1100 bytes
+(sm-inline) close "tiny"
+(sm-inline) open "tiny"
+(sm-inline) read 1100 bytes
+(sm-inline) close "tiny"
+(sm-inline) end
+EOF
+pass;
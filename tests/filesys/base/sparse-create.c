@@ -0,0 +1,56 @@
+/* Creates a large file, which must not write its sectors, reads a
+   stretch of it, which must not touch the disk, then writes into the
+   middle of it and reads that back. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define READ_OFS (512 * 1024)
+#define WRITE_OFS (700 * 1000)
+
+static char buf[64 * 1024];
+static char data[1000];
+
+void
+test_main (void)
+{
+  long long cnt;
+  size_t i;
+  int fd;
+
+  cnt = get_fs_disk_write_cnt ();
+  CHECK (create ("sparse", FILE_SIZE), "create \"sparse\"");
+  CHECK (get_fs_disk_write_cnt () - cnt < 16, "check write_cnt");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  CHECK (filesize (fd) == FILE_SIZE, "check size");
+
+  cnt = get_fs_disk_read_cnt ();
+  seek (fd, READ_OFS);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read %zu bytes at %d",
+         sizeof buf, READ_OFS);
+  CHECK (get_fs_disk_read_cnt () == cnt, "check read_cnt");
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d, not 0", READ_OFS + i, buf[i]);
+
+  random_bytes (data, sizeof data);
+  seek (fd, WRITE_OFS);
+  CHECK (write (fd, data, sizeof data) == sizeof data,
+         "write %zu bytes at %d", sizeof data, WRITE_OFS);
+  seek (fd, WRITE_OFS - sizeof data);
+  CHECK (read (fd, buf, 3 * sizeof data) == 3 * sizeof data,
+         "read around them");
+  for (i = 0; i < 3 * sizeof data; i++)
+    {
+      char expected = i / sizeof data == 1 ? data[i - sizeof data] : 0;
+      if (buf[i] != expected)
+        fail ("byte %zu is %d, not %d", WRITE_OFS - sizeof data + i,
+              buf[i], expected);
+    }
+  CHECK (filesize (fd) == FILE_SIZE, "check size");
+  msg ("close \"sparse\"");
+  close (fd);
+}
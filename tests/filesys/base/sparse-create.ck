@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse-create) begin
+(sparse-create) create "sparse"
+(sparse-create) check write_cnt
+(sparse-create) open "sparse"
+(sparse-create) check size
+(sparse-create) read 65536 bytes at 524288
+(sparse-create) check read_cnt
+(sparse-create) write 1000 bytes at 700000
+(sparse-create) read around them
+(sparse-create) check size
+(sparse-create) close "sparse"
+(sparse-create) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Spawns several child processes that each grow a file of their
+   own a chunk at a time while reading a file they all share.  With
+   a lock per inode, the reads of the shared file and the writes to
+   the other files do not wait for each other.  Then checks the
+   files the children wrote. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/base/syn-rw-many.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+char buf1[BUF_SIZE];
+char buf2[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd, i;
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  CHECK (write (fd, buf1, sizeof buf1) == sizeof buf1,
+         "write \"%s\"", shared_name);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+
+  exec_children ("child-syn-rwm", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "file%d", i);
+      random_init (i + 1);
+      random_bytes (buf1, sizeof buf1);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      CHECK (read (fd, buf2, sizeof buf2) == sizeof buf2,
+             "read \"%s\"", name);
+      compare_bytes (buf2, buf1, sizeof buf1, 0, name);
+      msg ("close \"%s\"", name);
+      close (fd);
+    }
+}
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-rw-many) begin
+(syn-rw-many) create "shared"
+(syn-rw-many) open "shared"
+(syn-rw-many) write "shared"
+(syn-rw-many) close "shared"
+(syn-rw-many) exec child 1 of 4: "child-syn-rwm 0"
+(syn-rw-many) exec child 2 of 4: "child-syn-rwm 1"
+(syn-rw-many) exec child 3 of 4: "child-syn-rwm 2"
+(syn-rw-many) exec child 4 of 4: "child-syn-rwm 3"
+(syn-rw-many) wait for child 1 of 4 returned 0 (expected 0)
+(syn-rw-many) wait for child 2 of 4 returned 1 (expected 1)
+(syn-rw-many) wait for child 3 of 4 returned 2 (expected 2)
+(syn-rw-many) wait for child 4 of 4 returned 3 (expected 3)
+(syn-rw-many) open "file0"
+(syn-rw-many) read "file0"
+(syn-rw-many) close "file0"
+(syn-rw-many) open "file1"
+(syn-rw-many) read "file1"
+(syn-rw-many) close "file1"
+(syn-rw-many) open "file2"
+(syn-rw-many) read "file2"
+(syn-rw-many) close "file2"
+(syn-rw-many) open "file3"
+(syn-rw-many) read "file3"
+(syn-rw-many) close "file3"
+(syn-rw-many) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BASE_SYN_RW_MANY_H
+#define TESTS_FILESYS_BASE_SYN_RW_MANY_H
+
+#define CHILD_CNT 4
+#define CHUNK_SIZE 512
+#define CHUNK_CNT 32
+#define BUF_SIZE (CHUNK_CNT * CHUNK_SIZE)
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/base/syn-rw-many.h */
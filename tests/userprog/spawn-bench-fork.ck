@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($expected) = "(spawn-bench) begin fork\n";
+$expected .= "(child-simple) run\nchild-simple: exit(81)\n" x 10;
+$expected .= "(spawn-bench) end\nspawn-bench-fork: exit(0)\n";
+check_expected ([$expected]);
+pass;
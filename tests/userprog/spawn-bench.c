@@ -0,0 +1,43 @@
+/* Starts child-simple CHILD_CNT times and waits for each, using
+   fork() followed by exec() or spawn() as selected by the first
+   command-line argument.  Compare the "Timer: N ticks" lines of
+   spawn-bench-fork and spawn-bench-spawn to see what the address
+   space copy of fork() costs. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+#define CHILD_CNT 10
+
+int
+main (int argc, char *argv[]) 
+{
+  bool use_spawn;
+  int i;
+
+  test_name = "spawn-bench";
+  if (argc != 2)
+    fail ("usage: spawn-bench fork|spawn");
+  use_spawn = !strcmp (argv[1], "spawn");
+
+  msg ("begin %s", argv[1]);
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pid_t pid;
+
+      if (use_spawn)
+        pid = spawn ("child-simple", NULL);
+      else if ((pid = fork ("child-simple")) == 0)
+        {
+          exec ("child-simple");
+          fail ("exec(\"child-simple\") failed");
+        }
+      if (pid == PID_ERROR)
+        fail ("child %d: could not start", i);
+      if (wait (pid) != 81)
+        fail ("child %d: wrong exit status", i);
+    }
+  msg ("end");
+  return 0;
+}
@@ -0,0 +1,34 @@
+/* Spawns child-simple, first as is and then with its standard
+   output redirected into a file, and verifies the file.  Spawning
+   an executable that does not exist must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char expected[] = "(child-simple) run\n";
+  struct spawn_fd_action actions[] = {{-1, 1}, {-1, -1}};
+  pid_t pid;
+  int fd;
+
+  msg ("spawn(\"child-simple\")");
+  if ((pid = spawn ("child-simple", NULL)) == PID_ERROR)
+    fail ("spawn() returned %d", pid);
+  msg ("wait(spawn()) = %d", wait (pid));
+
+  CHECK (create ("out", sizeof expected - 1), "create \"out\"");
+  CHECK ((fd = open ("out")) > 1, "open \"out\"");
+  actions[0].oldfd = fd;
+  msg ("spawn(\"child-simple\") with stdout on \"out\"");
+  if ((pid = spawn ("child-simple", actions)) == PID_ERROR)
+    fail ("spawn() returned %d", pid);
+  msg ("wait(spawn()) = %d", wait (pid));
+  close (fd);
+
+  check_file ("out", expected, sizeof expected - 1);
+
+  msg ("spawn(\"no-such-file\"): %d", spawn ("no-such-file", NULL));
+}
@@ -0,0 +1,44 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(spawn-simple) begin
+(spawn-simple) spawn("child-simple")
+(child-simple) run
+child-simple: exit(81)
+(spawn-simple) wait(spawn()) = 81
+(spawn-simple) create "out"
+(spawn-simple) open "out"
+(spawn-simple) spawn("child-simple") with stdout on "out"
+child-simple: exit(81)
+(spawn-simple) wait(spawn()) = 81
+(spawn-simple) open "out" for verification
+(spawn-simple) verified contents of "out"
+(spawn-simple) close "out"
+load: no-such-file: open failed
+no-such-file: exit(-1)
+(spawn-simple) spawn("no-such-file"): -1
+(spawn-simple) end
+spawn-simple: exit(0)
+EOF
+(spawn-simple) begin
+(spawn-simple) spawn("child-simple")
+(child-simple) run
+child-simple: exit(81)
+(spawn-simple) wait(spawn()) = 81
+(spawn-simple) create "out"
+(spawn-simple) open "out"
+(spawn-simple) spawn("child-simple") with stdout on "out"
+child-simple: exit(81)
+(spawn-simple) wait(spawn()) = 81
+(spawn-simple) open "out" for verification
+(spawn-simple) verified contents of "out"
+(spawn-simple) close "out"
+load: no-such-file: open failed
+(spawn-simple) spawn("no-such-file"): -1
+no-such-file: exit(-1)
+(spawn-simple) end
+spawn-simple: exit(0)
+EOF
+pass;
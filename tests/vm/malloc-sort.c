@@ -0,0 +1,74 @@
+/* Grows the heap with sbrk() and maps anonymous memory, then sorts
+   4 MB of random bytes in a malloc()ed buffer and builds and frees a
+   long list of small malloc()ed nodes. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/arc4.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/qsort.h"
+
+#define SIZE (4 * 1024 * 1024)
+#define NODES 20000
+
+struct node {
+  struct node *next;
+  int value;
+};
+
+void
+test_main (void)
+{
+  struct arc4 arc4;
+  struct node *head = NULL;
+  unsigned char *buf, *base;
+  char *anon;
+  size_t i;
+  int n;
+
+  base = sbrk (0);
+  CHECK (base != (void *) -1 && sbrk (8192) == base, "sbrk 8 kB");
+  for (i = 0; i < 8192; i++)
+    if (base[i] != 0)
+      fail ("heap byte %zu != 0", i);
+  memset (base, 0x5a, 8192);
+  CHECK (sbrk (-8192) == base + 8192 && sbrk (0) == base, "sbrk -8 kB");
+  CHECK (brk (base) == 0, "brk");
+
+  CHECK ((anon = mmap (NULL, 3 * 4096, 1, MAP_ANONYMOUS, 0)) != MAP_FAILED,
+         "mmap anonymous");
+  for (i = 0; i < 3 * 4096; i++)
+    if (anon[i] != 0)
+      fail ("mapped byte %zu != 0", i);
+  memset (anon, 0xa5, 3 * 4096);
+  munmap (anon);
+
+  CHECK ((buf = malloc (SIZE)) != NULL, "malloc 4 MB");
+  arc4_init (&arc4, "foobar", 6);
+  arc4_crypt (&arc4, buf, SIZE);
+  qsort_bytes (buf, SIZE);
+  for (i = 1; i < SIZE; i++)
+    if (buf[i - 1] > buf[i])
+      fail ("bytes %zu and %zu out of order", i - 1, i);
+  free (buf);
+  msg ("sorted 4 MB");
+
+  for (n = 0; n < NODES; n++) {
+    struct node *node = malloc (sizeof *node);
+    if (node == NULL)
+      fail ("malloc node %d", n);
+    node->value = n;
+    node->next = head;
+    head = node;
+  }
+  for (n = NODES - 1; head != NULL; n--) {
+    struct node *next = head->next;
+    if (head->value != n)
+      fail ("node %d holds %d", n, head->value);
+    free (head);
+    head = next;
+  }
+  msg ("built and freed %d nodes", NODES);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(malloc-sort) begin
+(malloc-sort) sbrk 8 kB
+(malloc-sort) sbrk -8 kB
+(malloc-sort) brk
+(malloc-sort) mmap anonymous
+(malloc-sort) malloc 4 MB
+(malloc-sort) sorted 4 MB
+(malloc-sort) built and freed 20000 nodes
+(malloc-sort) end
+EOF
+pass;
@@ -0,0 +1,22 @@
+/* Changes an initialized global and drops its page with madvise(),
+   and checks that the page comes back as the executable initialized
+   it, not as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char init[] = "initialized data";
+static char data[4096] __attribute__ ((aligned (4096))) = "initialized data";
+
+void
+test_main (void)
+{
+  memcpy (data, "changed", sizeof "changed");
+  CHECK (madvise (data, sizeof data, MADV_DONTNEED) == 0,
+         "madvise dontneed on initialized data");
+  if (strcmp (data, init))
+    fail ("data reads \"%s\", not \"%s\"", data, init);
+  msg ("data reloaded from executable");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-advise-data) begin
+(mmap-advise-data) madvise dontneed on initialized data
+(mmap-advise-data) data reloaded from executable
+(mmap-advise-data) end
+EOF
+pass;
@@ -0,0 +1,52 @@
+/* Uses msync() and madvise() on a file mapping and madvise() on
+   anonymous memory, and checks that data survives or is zeroed
+   as it should. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+
+static char anon[2 * 4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  static const char new[] = "msync";
+  size_t len = strlen (sample);
+  size_t i;
+  char *map;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (map, 4096, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  CHECK (madvise (map, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  if (memcmp (map, sample, len))
+    fail ("mapping differs from file");
+
+  memcpy (map, new, sizeof new - 1);
+  CHECK (msync (map, 4096) == 0, "msync");
+  CHECK (msync (map + 1, 4096) == -1, "msync at misaligned address");
+  CHECK (madvise (map, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+  if (memcmp (map, new, sizeof new - 1)
+      || memcmp (map + sizeof new - 1, sample + sizeof new - 1,
+                 len - (sizeof new - 1)))
+    fail ("mapping lost data");
+  msg ("mapping reloaded from file");
+
+  memset (anon, 0xaa, sizeof anon);
+  CHECK (madvise (anon, sizeof anon, MADV_DONTNEED) == 0,
+         "madvise dontneed on anonymous memory");
+  for (i = 0; i < sizeof anon; i++)
+    if (anon[i] != 0)
+      fail ("byte %zu is %d, not zero", i, anon[i]);
+  msg ("anonymous memory reads as zeros");
+
+  munmap (map);
+  close (handle);
+}
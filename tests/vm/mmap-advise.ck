@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-advise) begin
+(mmap-advise) open "sample.txt"
+(mmap-advise) mmap "sample.txt"
+(mmap-advise) madvise sequential
+(mmap-advise) madvise willneed
+(mmap-advise) msync
+(mmap-advise) msync at misaligned address
+(mmap-advise) madvise dontneed
+(mmap-advise) mapping reloaded from file
+(mmap-advise) madvise dontneed on anonymous memory
+(mmap-advise) anonymous memory reads as zeros
+(mmap-advise) end
+EOF
+pass;
@@ -0,0 +1,54 @@
+/* Maps a file twice and checks that a write through one mapping
+   is seen through the other one and by read() before anything is
+   unmapped, and that write() is seen through both mappings. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define ACTUAL2 ((void *) 0x20000000)
+
+void
+test_main (void)
+{
+  static const char msg1[] = "shared mapping";
+  static const char msg2[] = "written";
+  char *map1, *map2;
+  char buf[sizeof msg1];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map1 = mmap (ACTUAL, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK ((map2 = mmap (ACTUAL2, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\" again");
+  if (memcmp (map1, sample, strlen (sample)))
+    fail ("first mapping differs from file");
+
+  memcpy (map1, msg1, sizeof msg1 - 1);
+  if (memcmp (map2, msg1, sizeof msg1 - 1))
+    fail ("second mapping does not see the write");
+  msg ("second mapping sees the write");
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, sizeof msg1 - 1) == sizeof msg1 - 1,
+         "read \"sample.txt\"");
+  if (memcmp (buf, msg1, sizeof msg1 - 1))
+    fail ("read() does not see the write");
+  msg ("read() sees the write");
+
+  seek (handle, 100);
+  CHECK (write (handle, msg2, sizeof msg2 - 1) == sizeof msg2 - 1,
+         "write \"sample.txt\"");
+  if (memcmp (map1 + 100, msg2, sizeof msg2 - 1)
+      || memcmp (map2 + 100, msg2, sizeof msg2 - 1))
+    fail ("mappings do not see write()");
+  msg ("mappings see write()");
+
+  munmap (map1);
+  munmap (map2);
+  close (handle);
+}
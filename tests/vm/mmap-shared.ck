@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shared) begin
+(mmap-shared) open "sample.txt"
+(mmap-shared) mmap "sample.txt"
+(mmap-shared) mmap "sample.txt" again
+(mmap-shared) second mapping sees the write
+(mmap-shared) read "sample.txt"
+(mmap-shared) read() sees the write
+(mmap-shared) write "sample.txt"
+(mmap-shared) mappings see write()
+(mmap-shared) end
+EOF
+pass;
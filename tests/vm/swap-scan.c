@@ -0,0 +1,61 @@
+/* Keeps a small working set busy while streaming once over a region
+ * much larger than memory, with the 2Q eviction policy.  The working
+ * set is checked between every few pages of the scan: it must keep
+ * its data, and every page of it the frame it was first given, since
+ * the scan must not push it out even once.  Then the whole scanned
+ * region is checked.  For this test, Pintos memory size is 10MB. */
+
+#include <string.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define ONE_MB (1 << 20)
+#define SCAN_SIZE (16 * ONE_MB)
+#define SCAN_PAGES (SCAN_SIZE / PAGE_SIZE)
+#define HOT_PAGES 64
+#define TOUCH_EVERY 32
+
+static char scan[SCAN_SIZE];
+static char hot[HOT_PAGES * PAGE_SIZE];
+static void *hot_frame[HOT_PAGES];
+
+static void
+touch_hot (size_t round) {
+	size_t i;
+
+	for (i = 0; i < HOT_PAGES; i++) {
+		char *p = hot + i * PAGE_SIZE;
+		if (round > 0 && get_phys_addr (p) != hot_frame[i])
+			fail ("hot page %zu was evicted before round %zu", i, round);
+		if (round > 0 && *p != (char) (i + round - 1))
+			fail ("hot page %zu lost its data in round %zu", i, round);
+		*p = (char) (i + round);
+		if (round == 0)
+			hot_frame[i] = get_phys_addr (p);
+	}
+}
+
+void
+test_main (void)
+{
+	size_t i, round = 0;
+
+	touch_hot (round++);
+	for (i = 0; i < SCAN_PAGES; i++) {
+		if (!(i % 1024))
+			msg ("scan page %zu", i);
+		scan[i * PAGE_SIZE] = (char) i;
+		if (!(i % TOUCH_EVERY))
+			touch_hot (round++);
+	}
+	touch_hot (round++);
+	msg ("hot pages stayed in memory");
+
+	for (i = 0; i < SCAN_PAGES; i++)
+		if (scan[i * PAGE_SIZE] != (char) i)
+			fail ("scanned page %zu is inconsistent", i);
+	msg ("scanned data is consistent");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(swap-scan) begin
+(swap-scan) scan page 0
+(swap-scan) scan page 1024
+(swap-scan) scan page 2048
+(swap-scan) scan page 3072
+(swap-scan) hot pages stayed in memory
+(swap-scan) scanned data is consistent
+(swap-scan) end
+EOF
+pass;
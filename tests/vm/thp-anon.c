@@ -0,0 +1,51 @@
+/* Maps 4 MB of anonymous memory with transparent huge pages on and
+   checks that one fault maps a whole, physically contiguous 2 MB
+   page, and that copy on write after fork() and munmap() still work
+   on it. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 1024 * 1024)
+#define HUGE (2 * 1024 * 1024)
+#define PAGE 4096
+
+void
+test_main (void)
+{
+  char *map, *huge;
+  size_t i;
+  pid_t child;
+
+  CHECK ((map = mmap (NULL, SIZE, 1, MAP_ANONYMOUS, 0)) != MAP_FAILED,
+         "mmap 4 MB");
+  huge = (char *) (((uintptr_t) map + HUGE - 1) & ~(uintptr_t) (HUGE - 1));
+  huge[0] = 1;
+  for (i = 0; i < HUGE; i += PAGE)
+    if (get_phys_addr (huge + i) != (char *) get_phys_addr (huge) + i)
+      fail ("page %zu of the huge page is not mapped in place", i / PAGE);
+  msg ("one fault mapped 2 MB");
+
+  for (i = 0; i < SIZE; i += PAGE)
+    map[i] = i / PAGE;
+
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (i = 0; i < SIZE; i += PAGE)
+        map[i] = -1;
+      for (i = 0; i < SIZE; i += PAGE)
+        if (map[i] != -1)
+          exit (1);
+      exit (81);
+    }
+  CHECK (wait (child) == 81, "wait for child");
+  for (i = 0; i < SIZE; i += PAGE)
+    if (map[i] != (char) (i / PAGE))
+      fail ("byte at page %zu changed by the child", i / PAGE);
+  msg ("parent memory intact");
+
+  munmap (map);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(thp-anon) begin
+(thp-anon) mmap 4 MB
+(thp-anon) one fault mapped 2 MB
+(thp-anon) wait for child
+(thp-anon) parent memory intact
+(thp-anon) end
+EOF
+pass;
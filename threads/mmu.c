@@ -1,13 +1,142 @@
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process context identifiers.  With CR4.PCIDE set, the CPU tags TLB
+ * entries with the PCID in the low 12 bits of CR3, so switching to
+ * another pml4 does not have to flush the entries of the others.
+ * Each pml4 made by pml4_create() gets one of PCID_CNT - 1 PCIDs while
+ * they last.  PCID 0 belongs to base_pml4 and to the pml4s that got
+ * none; it is flushed on every switch. */
+#define PCID_CNT 32
+#define CR4_PCIDE (1 << 17)         /* CR4: PCIDs enabled. */
+#define CR3_NOFLUSH (1ULL << 63)    /* CR3 write: keep the PCID's entries. */
+#define CPUID_PCID (1 << 17)        /* CPUID.1:ECX: PCIDs supported. */
+#define CPUID_INVPCID (1 << 10)     /* CPUID.7:EBX: INVPCID supported. */
+
+static bool pcid_enabled;
+static bool invpcid_enabled;
+static uint64_t *pcid_owner[PCID_CNT];  /* pml4 of each PCID. */
+static bool pcid_stale[PCID_CNT];       /* Flush on next activation. */
+
+/* Statistics. */
+static long long tlb_page_flushes;      /* Single pages invalidated. */
+static long long tlb_full_flushes;      /* Whole PCIDs or TLBs flushed. */
+
+/* Turns PCIDs on if the CPU has them.  Must run with base_pml4 loaded,
+ * whose PCID is 0. */
+void
+pml4_pcid_init (void) {
+	uint32_t max, eax, ebx, ecx, edx;
+
+	cpuid (0, 0, &max, &ebx, &ecx, &edx);
+	cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_PCID))
+		return;
+	if (max >= 7) {
+		cpuid (7, 0, &eax, &ebx, &ecx, &edx);
+		invpcid_enabled = (ebx & CPUID_INVPCID) != 0;
+	}
+	lcr4 (rcr4 () | CR4_PCIDE);
+	pcid_enabled = true;
+}
+
+/* Returns the PCID of PML4, 0 if it has none. */
+static unsigned
+pcid_of (const uint64_t *pml4) {
+	if (pcid_enabled)
+		for (unsigned i = 1; i < PCID_CNT; i++)
+			if (pcid_owner[i] == pml4)
+				return i;
+	return 0;
+}
+
+/* Removes the TLB entry of VA in PML4, whose page table entry just
+ * changed.  Other pml4s than the current one only lose the entry if
+ * they have a PCID: with INVPCID, or else by a flush on their next
+ * activation. */
+static void
+tlb_flush_page (uint64_t *pml4, uint64_t va) {
+	struct tlb_batch *batch = thread_current ()->tlb_batch;
+	unsigned pcid;
+
+	if (batch != NULL && batch->pml4 == pml4) {
+		if (batch->cnt < TLB_BATCH_MAX)
+			batch->va[batch->cnt] = va;
+		batch->cnt++;
+	} else if (PTE_ADDR (rcr3 ()) == vtop (pml4)) {
+		invlpg (va);
+		tlb_page_flushes++;
+	} else if ((pcid = pcid_of (pml4)) != 0) {
+		if (invpcid_enabled) {
+			invpcid (0, pcid, va);
+			tlb_page_flushes++;
+		} else
+			pcid_stale[pcid] = true;
+	}
+}
+
+/* Starts deferring the TLB invalidations of the running thread in
+ * PML4 into BATCH.  Batches nest. */
+void
+tlb_batch_begin (struct tlb_batch *batch, uint64_t *pml4) {
+	struct thread *t = thread_current ();
+
+	batch->pml4 = pml4;
+	batch->cnt = 0;
+	batch->outer = t->tlb_batch;
+	t->tlb_batch = batch;
+}
+
+/* Does the invalidations collected in BATCH and ends it. */
+void
+tlb_batch_finish (struct tlb_batch *batch) {
+	uint64_t *pml4 = batch->pml4;
+	unsigned pcid;
+	bool current;
+
+	thread_current ()->tlb_batch = batch->outer;
+	if (batch->cnt == 0)
+		return;
+
+	current = PTE_ADDR (rcr3 ()) == vtop (pml4);
+	pcid = pcid_of (pml4);
+	if (batch->cnt <= TLB_BATCH_MAX && (current || (pcid && invpcid_enabled))) {
+		for (size_t i = 0; i < batch->cnt; i++)
+			if (current)
+				invlpg (batch->va[i]);
+			else
+				invpcid (0, pcid, batch->va[i]);
+		tlb_page_flushes += batch->cnt;
+	} else if (current) {
+		/* Without the no-flush bit, this drops the current PCID's
+		 * entries only. */
+		lcr3 (rcr3 ());
+		tlb_full_flushes++;
+	} else if (pcid != 0) {
+		if (invpcid_enabled) {
+			invpcid (1, pcid, 0);
+			tlb_full_flushes++;
+		} else
+			pcid_stale[pcid] = true;
+	}
+}
+
+/* Prints TLB invalidation statistics. */
+void
+tlb_print_stats (void) {
+	printf ("TLB: %lld pages invalidated, %lld full flushes\n",
+			tlb_page_flushes, tlb_full_flushes);
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -23,6 +152,8 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		if (pdp[idx] & PTE_PS)
+			return &pdp[idx];
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -60,7 +191,9 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
  * If PML4E does not have a page table for VADDR, behavior depends
  * on CREATE.  If CREATE is true, then a new page table is
  * created and a pointer into it is returned.  Otherwise, a null
- * pointer is returned. */
+ * pointer is returned.
+ * If VADDR lies in a 2 MiB page, the page directory entry, which has
+ * PTE_PS set, is returned instead of a page table entry. */
 uint64_t *
 pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	uint64_t *pte = NULL;
@@ -88,6 +221,71 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the next level table that entry IDX of TABLE points to,
+ * allocating it if it is not present and CREATE is true. */
+static uint64_t *
+table_walk (uint64_t *table, int idx, int create) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page;
+
+		if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+			return NULL;
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (table[idx]));
+}
+
+/* Returns the address of the page directory entry for virtual
+ * address VADDR in PML4, which maps 2 MiB at VADDR when PTE_PS is set
+ * in it.  Missing upper level tables are created if CREATE is true;
+ * otherwise a null pointer is returned for them. */
+uint64_t *
+pml4_pde_walk (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *pdp = table_walk (pml4, PML4 (va), create);
+	uint64_t *pd = pdp != NULL ? table_walk (pdp, PDPE (va), create) : NULL;
+
+	return pd != NULL ? &pd[PDX (va)] : NULL;
+}
+
+/* Replaces the 2 MiB page mapped by PDE in PML4 by a page table that
+ * maps the same memory with 4 kB pages and the same flags, so that
+ * one page of it can be changed on its own.  Returns false if no
+ * page table could be allocated. */
+static bool
+pde_split (uint64_t *pml4, uint64_t *pde, uint64_t va) {
+	uint64_t *pt = palloc_get_page (0);
+	uint64_t base = PTE_ADDR (*pde) & ~LARGE_PGMASK;
+	uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+	if (pt == NULL)
+		return false;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (base + i * PGSIZE) | flags;
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+	tlb_flush_page (pml4, va);
+	return true;
+}
+
+/* Like pml4e_walk(), but splits a 2 MiB page that covers VA first, so
+ * the result is always the page table entry of VA alone.
+ * If no page table is left for the split, the 2 MiB mapping is removed
+ * as a whole instead: its pages are anonymous and keep their frames,
+ * so they fault back in one by one.  The caller never changes a page
+ * while the huge mapping still reaches its frame. */
+static uint64_t *
+pte_walk (uint64_t *pml4, const uint64_t va, int create) {
+	uint64_t *pte = pml4e_walk (pml4, va, create);
+
+	if (pte != NULL && (*pte & PTE_PS)) {
+		if (pde_split (pml4, pte, va))
+			return pml4e_walk (pml4, va, false);
+		*pte = 0;
+		tlb_flush_page (pml4, va);
+		return create ? pml4e_walk (pml4, va, true) : NULL;
+	}
+	return pte;
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -95,8 +293,20 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 uint64_t *
 pml4_create (void) {
 	uint64_t *pml4 = palloc_get_page (0);
-	if (pml4)
+	if (pml4) {
 		memcpy (pml4, base_pml4, PGSIZE);
+		if (pcid_enabled) {
+			enum intr_level old_level = intr_disable ();
+			for (unsigned i = 1; i < PCID_CNT; i++)
+				if (pcid_owner[i] == NULL) {
+					/* The last owner may have left entries behind. */
+					pcid_owner[i] = pml4;
+					pcid_stale[i] = true;
+					break;
+				}
+			intr_set_level (old_level);
+		}
+	}
 	return pml4;
 }
 
@@ -122,10 +332,18 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (pdp[i] & PTE_PS) {
+			/* A 2 MiB page: FUNC gets the page directory entry. */
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+					pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -143,7 +361,8 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * For a 2 MiB page FUNC is called once, with its page directory entry. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +388,8 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		/* A 2 MiB page has no page table to free. */
+		if ((((uint64_t) pte) & PTE_P) && !(pdp[i] & PTE_PS))
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -196,14 +416,28 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	pcid_owner[pcid_of (pml4)] = NULL;
 	palloc_free_page ((void *) pml4);
 }
 
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  The TLB entries of a pml4 with its own PCID are kept,
+ * unless some of them went stale while it was not loaded. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	uint64_t *target = pml4 ? pml4 : base_pml4;
+	uint64_t cr3 = vtop (target);
+	unsigned pcid = pcid_of (target);
+
+	if (pcid != 0) {
+		cr3 |= pcid;
+		if (!pcid_stale[pcid])
+			cr3 |= CR3_NOFLUSH;
+		else
+			tlb_full_flushes++;
+		pcid_stale[pcid] = false;
+	}
+	lcr3 (cr3);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -216,6 +450,9 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) uaddr, 0);
 
+	if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+		return ptov (PTE_ADDR (*pte) & ~LARGE_PGMASK)
+			+ ((uint64_t) uaddr & LARGE_PGMASK);
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
 	return NULL;
@@ -236,10 +473,15 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 	ASSERT (is_user_vaddr (upage));
 	ASSERT (pml4 != base_pml4);
 
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
+	uint64_t *pte = pte_walk (pml4, (uint64_t) upage, 1);
+
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 
-	if (pte)
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			tlb_flush_page (pml4, (uint64_t) upage);
+	}
 	return pte != NULL;
 }
 
@@ -253,18 +495,18 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
 
-	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	pte = pte_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_flush_page (pml4, (uint64_t) upage);
 	}
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
- * installed.
+ * installed.  For a page in a 2 MiB page, that is the dirty bit of
+ * the whole 2 MiB page.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
@@ -283,15 +525,33 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
 		else
 			*pte &= ~(uint32_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, (uint64_t) vpage);
+	}
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+ * VPAGE in PML4, keeping the other bits (dirty, accessed) as is.
+ * Write protecting a page in a 2 MiB page protects all of it; a
+ * write fault on the other pages makes them writable again. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = writable ? pte_walk (pml4, (uint64_t) vpage, false)
+		: pml4e_walk (pml4, (uint64_t) vpage, false);
+	if (pte) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+
+		tlb_flush_page (pml4, (uint64_t) vpage);
 	}
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
  * accessed recently, that is, between the time the PTE was
- * installed and the last time it was cleared.  Returns false if
- * PML4 contains no PTE for VPAGE. */
+ * installed and the last time it was cleared.  A 2 MiB page has a
+ * single accessed bit for all its pages.  Returns false if PML4
+ * contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
@@ -309,7 +569,6 @@ pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
 		else
 			*pte &= ~(uint32_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_flush_page (pml4, (uint64_t) vpage);
 	}
 }
@@ -284,6 +284,40 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	return pages;
 }
 
+/* Like palloc_get_multiple(), but the PAGE_CNT pages also start at
+   an address that is a multiple of PAGE_CNT pages, which must be a
+   power of 2.  Used for the 2 MiB pages of transparent huge pages. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	size_t align = page_cnt * PGSIZE;
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t page_idx;
+	void *pages = NULL;
+
+	ASSERT ((page_cnt & (page_cnt - 1)) == 0);
+
+	lock_acquire (&pool->lock);
+	for (page_idx = (ROUND_UP ((uint64_t) pool->base, align)
+				- (uint64_t) pool->base) / PGSIZE;
+			page_idx + page_cnt <= pool_cnt; page_idx += page_cnt)
+		if (bitmap_none (pool->used_map, page_idx, page_cnt)) {
+			bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+			pages = pool->base + PGSIZE * page_idx;
+			break;
+		}
+	lock_release (&pool->lock);
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, PGSIZE * page_cnt);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get: out of pages");
+	}
+	return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -296,6 +330,14 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Stores the first page of the user pool in *BASE and its number of
+   pages in *PAGE_CNT.  Every PAL_USER page lies in that range. */
+void
+palloc_user_pool (void **base, size_t *page_cnt) {
+	*base = user_pool.base;
+	*page_cnt = bitmap_size (user_pool.used_map);
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
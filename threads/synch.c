@@ -364,3 +364,77 @@ bool cmp_sem_priority(struct list_elem *e1, struct list_elem *e2){
 	struct thread *t2 = list_entry(list_front(&sema_wait2), struct thread, elem);
 	return t1->priority > t2->priority;
 }
+
+/* Initializes RWLOCK, which nobody holds. */
+void
+rwlock_init (struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->can_read);
+	cond_init (&rw->can_write);
+	rw->readers = 0;
+	rw->writers_waiting = 0;
+	rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or waits
+ * for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) {
+	ASSERT (!intr_context ());
+
+	lock_acquire (&rw->lock);
+	while (rw->writer != NULL || rw->writers_waiting > 0)
+		cond_wait (&rw->can_read, &rw->lock);
+	rw->readers++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, held for reading. */
+void
+rwlock_release_read (struct rwlock *rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0)
+		cond_signal (&rw->can_write, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping while anybody else holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw) {
+	ASSERT (!intr_context ());
+	ASSERT (!rwlock_held_for_write (rw));
+
+	lock_acquire (&rw->lock);
+	rw->writers_waiting++;
+	while (rw->writer != NULL || rw->readers > 0)
+		cond_wait (&rw->can_write, &rw->lock);
+	rw->writers_waiting--;
+	rw->writer = thread_current ();
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, held for writing by the running thread.  The next
+ * waiting writer goes first; readers enter once none is left. */
+void
+rwlock_release_write (struct rwlock *rw) {
+	ASSERT (rwlock_held_for_write (rw));
+
+	lock_acquire (&rw->lock);
+	rw->writer = NULL;
+	if (rw->writers_waiting > 0)
+		cond_signal (&rw->can_write, &rw->lock);
+	else
+		cond_broadcast (&rw->can_read, &rw->lock);
+	lock_release (&rw->lock);
+}
+
+/* Returns true if the running thread holds RW for writing. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rw->writer == thread_current ();
+}
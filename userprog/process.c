@@ -27,6 +27,7 @@ static void process_cleanup(void);
 static bool load(const char *file_name, struct intr_frame *if_);
 static void initd(void *f_name);
 static void __do_fork(void *);
+static void __do_spawn(void *);
 void argument_stack(char **parse, int count, struct intr_frame *if_);
 static struct lock lock_p;
 /* General process initializer for initd and other process. */
@@ -159,6 +160,58 @@ struct dict_elem
 	uintptr_t value;
 };
 
+/* Duplicates the file descriptor table of PARENT into CURRENT.  A file
+ * that several descriptors share (dup2) is duplicated only once.
+ * Returns false if the table of PARENT is full. */
+static bool
+duplicate_fd_table(struct thread *parent, struct thread *current)
+{
+	const int DICTLEN = 10;
+	struct dict_elem dup_file_dict[10];
+	int dup_idx = 0;
+
+	if (parent->fd_idx == FDCOUNT_LIMIT)
+		return false;
+
+	for (int i = 0; i < FDCOUNT_LIMIT; i++)
+	{
+		struct file *f = parent->fd_table[i];
+		if (f == NULL)
+			continue;
+
+		// If 'file' is already duplicated in child, don't duplicate again but share it
+		bool found = false;
+
+		for (int j = 0; j <= dup_idx; j++)
+		{
+			if (dup_file_dict[j].key == f)
+			{
+				current->fd_table[i] = dup_file_dict[j].value;
+				found = true;
+				break;
+			}
+		}
+		if (found)
+			continue;
+		struct file *new_f;
+		if (f > 2)
+			new_f = file_duplicate(f);
+		else
+			new_f = f;
+
+		current->fd_table[i] = new_f;
+
+		if (dup_idx < DICTLEN)
+		{
+			dup_file_dict[dup_idx].key = f;
+			dup_file_dict[dup_idx].value = new_f;
+			dup_idx++;
+		}
+	}
+	current->fd_idx = parent->fd_idx;
+	return true;
+}
+
 /* A thread function that copies parent's execution context.
  * Hint) parent->tf does not hold the userland context of the process.
  *       That is, you are required to pass second argument of process_fork to
@@ -175,10 +228,6 @@ __do_fork(void *aux)
 	bool succ = true;
 	parent_if = &parent->parent_if;
 
-	const int DICTLEN = 10;
-	struct dict_elem dup_file_dict[10];
-	int dup_idx = 0;
-
 	/* 1. Read the cpu context to local stack. */
 	memcpy(&if_, &parent->parent_if, sizeof(struct intr_frame));
 
@@ -194,6 +243,9 @@ __do_fork(void *aux)
 	supplemental_page_table_init(&current->spt);
 	if (!supplemental_page_table_copy(&current->spt, &parent->spt))
 		goto error;
+	current->stack_bottom = parent->stack_bottom;
+	current->heap_start = parent->heap_start;
+	current->heap_end = parent->heap_end;
 #else
 	if (!pml4_for_each(parent->pml4, duplicate_pte, parent))
 		goto error;
@@ -207,53 +259,100 @@ __do_fork(void *aux)
 	/* System call 추가 */
 	// process_init ();
 	// multi-oom) Failed to duplicate
-	if (parent->fd_idx == FDCOUNT_LIMIT)
+	if (!duplicate_fd_table(parent, current))
 		goto error;
-
-	for (int i = 0; i < FDCOUNT_LIMIT; i++)
+	sema_up(&current->fork_sema);
+	/* Finally, switch to the newly created process. */
+	if (succ)
 	{
-		struct file *f = parent->fd_table[i];
-		if (f == NULL)
-			continue;
+		do_iret(&if_);
+	}
 
-		// If 'file' is already duplicated in child, don't duplicate again but share it
-		bool found = false;
+error:
+	current->exit_status = TID_ERROR;
+	sema_up(&current->fork_sema);
+	exit(TID_ERROR);
+}
 
-		for (int j = 0; j <= dup_idx; j++)
-		{
-			if (dup_file_dict[j].key == f)
-			{
-				current->fd_table[i] = dup_file_dict[j].value;
-				found = true;
-				break;
-			}
-		}
-		if (found)
-			continue;
-		struct file *new_f;
-		if (f > 2)
-			new_f = file_duplicate(f);
-		else
-			new_f = f;
+/* Arguments handed from process_spawn() to __do_spawn(). */
+struct spawn_args
+{
+	struct thread *parent;
+	char *cmd_line;
+	const struct spawn_fd_action *actions;
+};
 
-		current->fd_table[i] = new_f;
+/* Starts a new process running CMD_LINE, like fork() followed by exec()
+ * in the child, but without duplicating the address space of the
+ * caller.  ACTIONS, if not NULL, is applied to the fd table inherited
+ * by the child before the executable is loaded; it ends with an entry
+ * whose OLDFD is negative.  Returns the new process's thread id, or
+ * TID_ERROR if the thread cannot be created or the executable cannot
+ * be loaded, as exec() would report it. */
+tid_t process_spawn(const char *cmd_line, const struct spawn_fd_action *actions)
+{
+	struct spawn_args args;
+	char name[16];
+	size_t len;
+
+	args.parent = thread_current();
+	args.actions = actions;
+	args.cmd_line = palloc_get_page(0);
+	if (args.cmd_line == NULL)
+		return TID_ERROR;
+	strlcpy(args.cmd_line, cmd_line, PGSIZE);
 
-		if (dup_idx < DICTLEN)
-		{
-			dup_file_dict[dup_idx].key = f;
-			dup_file_dict[dup_idx].value = new_f;
-			dup_idx++;
-		}
+	len = strcspn(cmd_line, " ");
+	strlcpy(name, cmd_line, len + 1 < sizeof name ? len + 1 : sizeof name);
+
+	tid_t tid = thread_create(name, PRI_DEFAULT, __do_spawn, &args);
+	if (tid == TID_ERROR)
+	{
+		palloc_free_page(args.cmd_line);
+		return TID_ERROR;
 	}
-	current->fd_idx = parent->fd_idx;
-	sema_up(&current->fork_sema);
-	/* Finally, switch to the newly created process. */
-	if (succ)
+	struct thread *child = get_child_with_pid(tid);
+	sema_down(&child->fork_sema);
+	if (child->exit_status == -1)
 	{
-		do_iret(&if_);
+		return TID_ERROR;
+	}
+
+	return tid;
+}
+
+/* A thread function that sets up the fd table of a spawned process
+ * and loads its executable.  The parent waits on fork_sema until
+ * process_exec() knows whether the load succeeded, so AUX stays valid
+ * up to that point. */
+static void
+__do_spawn(void *aux)
+{
+	struct spawn_args *args = aux;
+	struct thread *current = thread_current();
+	char *cmd_line = args->cmd_line;
+	const struct spawn_fd_action *a;
+
+#ifdef VM
+	supplemental_page_table_init(&current->spt);
+#endif
+	if (!duplicate_fd_table(args->parent, current))
+		goto error;
+	for (a = args->actions; a != NULL && a->oldfd >= 0; a++)
+	{
+		if (a->newfd < 0)
+			close(a->oldfd);
+		else if (dup2(a->oldfd, a->newfd) < 0)
+			goto error;
 	}
 
+	current->spawning = true;
+	if (process_exec(cmd_line) < 0)
+		exit(-1);
+	NOT_REACHED();
+
 error:
+	palloc_free_page(cmd_line);
 	current->exit_status = TID_ERROR;
 	sema_up(&current->fork_sema);
 	exit(TID_ERROR);
@@ -284,6 +383,14 @@ int process_exec(void *f_name)
 	// hex_dump(_if.rsp,_if.rsp, USER_STACK - _if.rsp,true);
 	/* If load failed, quit. */
 	palloc_free_page(file_name);
+	/* A spawned process reports the load to its parent. */
+	if (thread_current()->spawning)
+	{
+		thread_current()->spawning = false;
+		if (!success)
+			thread_current()->exit_status = TID_ERROR;
+		sema_up(&thread_current()->fork_sema);
+	}
 	if (!success)
 		return -1;
 
@@ -457,6 +564,9 @@ load(const char *file_name, struct intr_frame *if_)
 	if (t->pml4 == NULL)
 		goto done;
 	process_activate(thread_current());
+#ifdef VM
+	t->heap_start = t->heap_end = NULL;
+#endif
 
 	/* Arguments Parsing */
 	/* 인자들을 띄어쓰기 기준으로 토큰화 및 토큰의 개수 계산 */
@@ -473,9 +583,7 @@ load(const char *file_name, struct intr_frame *if_)
 	}
 
 	/* Open executable file. */
-	lock_acquire(&lock_read);
 	file = filesys_open(file_name);
-	lock_release(&lock_read);
 	if (file == NULL)
 	{
 		printf("load: %s: open failed\n", file_name);
@@ -550,6 +658,10 @@ load(const char *file_name, struct intr_frame *if_)
 					if (!load_segment (file, file_page, (void *) mem_page,
 								read_bytes, zero_bytes, writable))
 						goto done;
+#ifdef VM
+					if ((void *) (mem_page + read_bytes + zero_bytes) > t->heap_start)
+						t->heap_start = (void *) (mem_page + read_bytes + zero_bytes);
+#endif
 				}
 				else
 					goto done;
@@ -561,6 +673,11 @@ load(const char *file_name, struct intr_frame *if_)
 	if (!setup_stack(if_))
 		goto done;
 
+#ifdef VM
+	/* The heap starts as an empty break right above the highest segment. */
+	t->heap_end = t->heap_start;
+#endif
+
 	/* Start address. */
 	if_->rip = ehdr.e_entry;
 
@@ -774,8 +891,6 @@ bool lazy_load_segment(struct page *page, void *aux)
 	/* TODO: Load the segment from the file */
 	/* TODO: This called when the first page fault occurs on address VA. */
 	/* TODO: VA is available when calling this function. */
-	if (page->frame->write_protected > 1)
-		return true;
 	// if(page->uninit.aux == NULL) return false;
 	struct file_info *file_info = (struct file_info *)aux;
 	int temp;
@@ -790,12 +905,11 @@ bool lazy_load_segment(struct page *page, void *aux)
 	// printf("file_length %d\n", file_length(file_info->file));
 	// hex_dump(page->frame->kva, page->frame->kva, PGSIZE, true);
 	// if (file_info->ofs < 0) return false;
-	file_seek(file_info->file, file_info->ofs);
-	if (temp = file_read(file_info->file, page->frame->kva, file_info->read_bytes) != file_info->read_bytes)
-	{
-		palloc_free_page(page->frame->kva);
+	/* Runs without lock_vm, and a forked child shares FILE, so the
+	 * file position is left alone.  The frame stays with the page,
+	 * which frees it when destroyed. */
+	if (temp = file_read_at(file_info->file, page->frame->kva, file_info->read_bytes, file_info->ofs) != file_info->read_bytes)
 		return false;
-	}
 	// printf("pml4 page%p\n", pml4_get_page(thread_current()->pml4, page->va));
 	memset(page->frame->kva + file_info->read_bytes, 0, file_info->zero_bytes);
 	// printf("check content %s\n", page->va);
@@ -13,7 +13,11 @@
 #include "threads/synch.h"
 #include "lib/string.h"
 #include "threads/palloc.h"
+#include "threads/vaddr.h"
 #include "vm/file.h"
+#ifdef VM
+#include "vm/filemap.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
@@ -29,6 +33,7 @@ int read (int fd, void *buffer, unsigned size);
 int write (int fd, const void *buffer, unsigned size);
 struct file* find_file(int fd);
 int fork (const char *thread_name,struct intr_frame* if_);
+int spawn (const char *cmd_line, const struct spawn_fd_action *actions);
 int wait (int pid);
 void close (int fd);
 void seek (int fd, unsigned position);
@@ -37,8 +42,14 @@ int add_file(struct file *file);
 int dup2(int oldfd, int newfd);
 void remove_file(int fd);
 void check_valid_buffer (void *buffer, size_t size, bool to_write, struct intr_frame *f);
+#ifdef VM
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void * addr);
+int msync (void *addr, size_t length);
+int madvise (void *addr, size_t length, int advice);
+int brk (void *addr);
+void *sbrk (intptr_t increment);
+#endif
 /* System call.
  *
  * Previously system call services was handled by the interrupt handler
@@ -61,7 +72,6 @@ void munmap(void * addr);
 
 void
 syscall_init (void) {
-	lock_init(&lock_read);
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
 			((uint64_t)SEL_KCSEG) << 32);
 	write_msr(MSR_LSTAR, (uint64_t) syscall_entry);
@@ -117,6 +127,10 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		check_address(f->R.rdi);
 		f->R.rax = fork(f->R.rdi,f);
 		break;
+	case SYS_SPAWN:
+		check_address(f->R.rdi);
+		f->R.rax = spawn(f->R.rdi, f->R.rsi);
+		break;
 	case SYS_WAIT:
 		f->R.rax = wait(f->R.rdi);
 		break;
@@ -132,6 +146,7 @@ syscall_handler (struct intr_frame *f UNUSED) {
 	case SYS_DUP2:	// project2 - extra
 		f->R.rax = dup2(f->R.rdi, f->R.rsi);
 		break;
+#ifdef VM
 	case SYS_MMAP:
 		f->R.rax = mmap(f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
 		break;
@@ -139,6 +154,19 @@ syscall_handler (struct intr_frame *f UNUSED) {
 		check_address(f->R.rdi);
 		munmap(f->R.rdi);
 		break;
+	case SYS_MSYNC:
+		f->R.rax = msync(f->R.rdi, f->R.rsi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise(f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_BRK:
+		f->R.rax = brk(f->R.rdi);
+		break;
+	case SYS_SBRK:
+		f->R.rax = sbrk(f->R.rdi);
+		break;
+#endif
 	}
 }
 
@@ -148,7 +176,7 @@ int dup2(int oldfd, int newfd) {
 	// oldfd가 불분명하면 이 시스템 콜은 실패하며 -1을 리턴, newfd는 닫히지 않는다.
 	// oldfd가 명확하고 newfd가 oldfd와 같은 값을 가진다면, dup2() 함수는 실행되지 않고 newfd값을 그대로 반환
 	struct file *file = find_file(oldfd);
-	if (file == NULL){
+	if (file == NULL || newfd < 0 || newfd >= FDCOUNT_LIMIT){
 		return -1;
 	}
 	if (oldfd == newfd){
@@ -237,22 +265,44 @@ void exit (int status){
 	thread_exit();
 }
 
+/* Copies the user string PATH into a new kernel page, which the caller
+ * frees.  The file system may hold a journal operation open while it
+ * reads a path, and a fault on user memory there would wait for
+ * lock_vm, whose holder may wait for that operation to commit.
+ * Returns NULL if out of memory. */
+static char *
+copy_in_path (const char *path) {
+	char *copy = palloc_get_page(0);
+
+	if (copy != NULL)
+		strlcpy(copy, path, PGSIZE);
+	return copy;
+}
+
 /* Project2-3 System Call */
 bool create(const char *file, unsigned initial_size){
 	// check_address(file);
-	// lock_acquire(&lock_read);
-	bool succ = filesys_create(file,initial_size);
-	// lock_acquire(&lock_read);
+	char *path = copy_in_path(file);
+	bool succ;
+
+	if (path == NULL)
+		return false;
+	succ = filesys_create(path,initial_size);
+	palloc_free_page(path);
 	return succ;
 }
 
 /* Project2-3 System Call */
 bool remove(const char *file){
 	// check_address(file);
-	if(filesys_remove(file)){
-		return true;
-	}
-	return false;
+	char *path = copy_in_path(file);
+	bool succ;
+
+	if (path == NULL)
+		return false;
+	succ = filesys_remove(path);
+	palloc_free_page(path);
+	return succ;
 }
 
 /* Project2-3 System Call */
@@ -274,22 +324,21 @@ int exec (const char *cmd_line){
 /* Project2-3 System Call */
 int open (const char *file){
 	// check_address(file);
-	struct file *fileobj = (struct file*)malloc(sizeof(struct file));
-	struct file *temp = filesys_open(file);
-	
+	char *path = copy_in_path(file);
+	struct file *fileobj;
+	struct file *temp;
+
+	if (path == NULL)
+		return -1;
+	fileobj = (struct file*)malloc(sizeof(struct file));
+	temp = filesys_open(path);
+	palloc_free_page(path);
 	if (temp == NULL || fileobj == NULL)
 		return -1;
 
 	memcpy(fileobj, temp, sizeof(struct file));
-	// lock_acquire(&lock_read);
-	// struct file *fileobj = filesys_open(file);
-	// lock_release(&lock_read);
-	// if(fileobj == NULL)
-	// 	return -1;
 
-	lock_acquire(&lock_read);
 	int fd = add_file(fileobj); // fdt : file data table
-	lock_release(&lock_read);
 	// fd table이 가득 찼다면
 	if (fd == -1) {
 		file_close(fileobj);
@@ -323,6 +372,60 @@ int filesize (int fd){
 	return file_length(file);
 }
 
+/* Reads SIZE bytes from FILE into the user BUFFER, a page at a time
+ * through a kernel page.  The user buffer is only touched with no
+ * file system lock held, since a fault on it may load a page from a
+ * file.  Returns the number of bytes read, or -1. */
+static int
+read_file (struct file *file, void *buffer, unsigned size) {
+	uint8_t *bounce = palloc_get_page(0);
+	unsigned total = 0;
+
+	if (bounce == NULL)
+		return -1;
+	while (total < size) {
+		off_t chunk = size - total < PGSIZE ? size - total : PGSIZE;
+#ifdef VM
+		off_t n = filemap_read(file, bounce, chunk);
+#else
+		off_t n = file_read(file, bounce, chunk);
+#endif
+		memcpy((uint8_t *) buffer + total, bounce, n);
+		total += n;
+		if (n < chunk)
+			break;
+	}
+	palloc_free_page(bounce);
+	return total;
+}
+
+/* Writes SIZE bytes from the user BUFFER to FILE, like read_file().
+ * Returns the number of bytes written, or -1. */
+static int
+write_file (struct file *file, const void *buffer, unsigned size) {
+	uint8_t *bounce = palloc_get_page(0);
+	unsigned total = 0;
+
+	if (bounce == NULL)
+		return -1;
+	while (total < size) {
+		off_t chunk = size - total < PGSIZE ? size - total : PGSIZE;
+		off_t n;
+
+		memcpy(bounce, (const uint8_t *) buffer + total, chunk);
+#ifdef VM
+		n = filemap_write(file, bounce, chunk);
+#else
+		n = file_write(file, bounce, chunk);
+#endif
+		total += n;
+		if (n < chunk)
+			break;
+	}
+	palloc_free_page(bounce);
+	return total;
+}
+
 /* Project2-3 System Call */
 int read (int fd, void *buffer, unsigned size){
 	off_t char_count = 0;
@@ -368,9 +471,7 @@ int read (int fd, void *buffer, unsigned size){
 		
 	}
 	else{
-		lock_acquire(&lock_read);
-		char_count = file_read(file,buffer,size);
-		lock_release(&lock_read);
+		char_count = read_file(file,buffer,size);
 		// printf("check buffer %s\n",buffer);
 		// printf("check char_count %d\n", char_count);
 	}
@@ -400,10 +501,8 @@ int write (int fd, const void *buffer, unsigned size) {
 		}
 		putbuf(buffer, size);
 		return size;
-  	}else{
-		lock_acquire(&lock_read);
-		write_size = file_write(file,buffer,size);
-		lock_release(&lock_read);
+ 	}else{
+		write_size = write_file(file,buffer,size);
 	} 
 	return write_size;
 }
@@ -423,6 +522,32 @@ int fork (const char *thread_name,struct intr_frame* if_){
 	return process_fork(thread_name,if_);
 }
 
+/* Copies the fd actions into the kernel, as the child reads them only
+ * once it runs, then creates the process.  Returns -1 if an action
+ * names an fd outside the fd table. */
+int spawn (const char *cmd_line, const struct spawn_fd_action *actions){
+	struct spawn_fd_action copy[SPAWN_ACTIONS_MAX + 1];
+	int cnt = 0;
+
+	if (actions != NULL) {
+		while (true) {
+			check_address(&actions[cnt]);
+			check_address((char *) &actions[cnt + 1] - 1);
+			if (actions[cnt].oldfd < 0)
+				break;
+			if (cnt == SPAWN_ACTIONS_MAX
+					|| actions[cnt].oldfd >= FDCOUNT_LIMIT
+					|| actions[cnt].newfd >= FDCOUNT_LIMIT)
+				return -1;
+			copy[cnt] = actions[cnt];
+			cnt++;
+		}
+	}
+	copy[cnt].oldfd = -1;
+	copy[cnt].newfd = -1;
+	return process_spawn(cmd_line, copy);
+}
+
 /* Project2-3 System Call */
 int wait (int pid){
 	return process_wait(pid);
@@ -484,9 +609,18 @@ unsigned tell (int fd){
 	return file_tell(file);
 }
 
+#ifdef VM
 void *
 mmap (void *addr, size_t length, int writable, int fd, off_t offset){
 
+	if (fd == MAP_ANONYMOUS) {
+		if ((int) length <= 0 || offset != 0 || pg_round_down(addr) != addr)
+			return NULL;
+		if (addr + length > KERN_BASE || addr > KERN_BASE)
+			return NULL;
+		return do_mmap_anon(addr, length, writable);
+	}
+
 	if (addr <= 0 || (int) length <= 0) 
 		return NULL;
 
@@ -526,4 +660,22 @@ mmap (void *addr, size_t length, int writable, int fd, off_t offset){
 
 void munmap(void * addr){
 	do_munmap(addr);
-}
\ No newline at end of file
+}
+
+int msync (void *addr, size_t length){
+	return do_msync(addr, length);
+}
+
+int madvise (void *addr, size_t length, int advice){
+	return vm_madvise(addr, length, advice);
+}
+
+int brk (void *addr){
+	void *brk = thread_current()->heap_end;
+	return sbrk(addr - brk) == (void *) -1 ? -1 : 0;
+}
+
+void *sbrk (intptr_t increment){
+	return vm_sbrk(increment);
+}
+#endif
@@ -1,7 +1,11 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include "vm/filemap.h"
+#include <round.h>
+#include <string.h>
 #include "devices/disk.h"
+#include "threads/malloc.h"
 #include "lib/kernel/bitmap.h"
 /* DO NOT MODIFY BELOW LINE */
 struct bitmap *swap_table;
@@ -18,6 +22,9 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* Number of disk sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
@@ -25,7 +32,8 @@ vm_anon_init (void) {
 	swap_disk = NULL;
 	swap_disk = disk_get(1, 1);
 	size_t swap_disk_size = disk_size(swap_disk);
-	swap_table = bitmap_create(swap_disk_size >> 3);
+	swap_table = bitmap_create(swap_disk_size / SECTORS_PER_SLOT);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
@@ -35,10 +43,15 @@ anon_initializer (struct page *page, enum vm_type type, void *kva) {
 	// printf("check in anon_init\n");
 	page->operations = &anon_ops;
 	struct anon_page *anon_page = &page->anon;
-	anon_page->bit_idx = bitmap_size(swap_table) + 1;
+	anon_page->swap = NULL;
+	anon_page->dropped = false;
 	vm_initializer *init = anon_page->init;
 	anon_page->aux = page->uninit.aux;
 	anon_page->type = type;
+	/* Without an initializer the page must read as zeros, like the
+	 * shared zero frame it may have been mapped to until now. */
+	if (init == NULL)
+		memset (kva, 0, PGSIZE);
 	// if(page->frame->kva == 0x8004521000) printf("check anon_init\n");
 	// void *aux = anon_page->aux;
 	// task init_function.
@@ -52,22 +65,23 @@ static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
 
-	// printf("check swap_in page->bit_idx %d\n", anon_page->bit_idx);
-	// printf("check swap_in page->va %p\n", page->va);
-	// printf("check bit_size %d\n", bitmap_size(swap_table));
-	// printf("check swapin bitmap_test %d\n", bitmap_test(swap_table, anon_page->bit_idx));
-	if (anon_page->bit_idx > bitmap_size(swap_table)) return true;
-	if (bitmap_test(swap_table, anon_page->bit_idx) == false) return false;
-	for (int i = 0; i < 8; i++)
-		disk_read(swap_disk, (anon_page->bit_idx) * 8 + i, kva + 512 * i);
-	// lock_acquire(&lock);
-	bitmap_set(swap_table, anon_page->bit_idx, 0);
-	// lock_release(&lock);
-	// printf("check swap_in kva %s\n", kva);
-	// printf("check swap_in page->frame->page->va %p\n", page->frame->page->va);
-	// printf("check swap_in page-->va %p\n", page->va);
-	// vm_claim_page(page->va);
-	anon_page->bit_idx = bitmap_size(swap_table) + 1;
+	/* Not swapped out: a new frame for a copy on write, whose caller
+	 * fills it, or a page dropped by madvise().  A dropped page of an
+	 * executable segment is loaded from the executable again, any
+	 * other page reads as zeros. */
+	if (anon_page->swap == NULL) {
+		bool dropped = anon_page->dropped;
+
+		anon_page->dropped = false;
+		if (dropped && anon_page->init != NULL)
+			return anon_page->init (page, anon_page->aux);
+		memset (kva, 0, PGSIZE);
+		return true;
+	}
+	if (!zswap_load (anon_page->swap, kva))
+		return false;
+	zswap_free (anon_page->swap);
+	anon_page->swap = NULL;
 	return true;
 }
 
@@ -75,41 +89,64 @@ anon_swap_in (struct page *page, void *kva) {
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
-	struct thread *page_holder = page->frame->thread;
-	// printf("check swap_out page->va %p\n", page->va);
-	// printf("check page->bitmap_idx %d\n", anon_page->bit_idx);
-	// hex_dump(page->frame->kva, page->frame->kva, PGSIZE, true);
-	size_t bitmap_idx = bitmap_scan(swap_table, 0, 1, 0);
-	if (bitmap_idx == BITMAP_ERROR) return false;
-	if (anon_page->bit_idx <= bitmap_size(swap_table)) return false;
-	//이부분 효율성 추구헤보기.
-	disk_sector_t sector_idx = bitmap_idx * 8;
-	for(int i = 0; i < 8; i++)
-		disk_write(swap_disk, sector_idx + i, page->va + 512 * i);
-	// lock_acquire(&lock);
-	bitmap_set(swap_table, bitmap_idx, 1);
-	// lock_release(&lock);
-	anon_page->bit_idx = bitmap_idx;
-	// palloc_free_page(page->frame->kva);
+	struct thread *page_holder = page->owner;
+
+	ASSERT (anon_page->swap == NULL);
+	/* Compressed RAM tier first, the swap disk only takes what does not
+	 * compress or what zswap spills. */
+	anon_page->swap = zswap_store (page->frame->kva);
+	if (anon_page->swap == NULL)
+		return false;
 	pml4_clear_page(page_holder->pml4, page->va);
-	// free(page->frame);
 	page->frame = NULL;
 	return true;
 }
 
+/* Writes the page at KVA to a free swap slot and returns the slot, or
+ * BITMAP_ERROR if the swap disk is full. */
+size_t
+swap_slot_write (const void *kva) {
+	size_t slot = bitmap_scan_and_flip (swap_table, 0, 1, false);
+	if (slot == BITMAP_ERROR)
+		return BITMAP_ERROR;
+	for (int i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				kva + DISK_SECTOR_SIZE * i);
+	return slot;
+}
+
+/* Reads swap SLOT into the page at KVA. */
+void
+swap_slot_read (size_t slot, void *kva) {
+	ASSERT (bitmap_test (swap_table, slot));
+	for (int i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				kva + DISK_SECTOR_SIZE * i);
+}
+
+/* Releases swap SLOT. */
+void
+swap_slot_free (size_t slot) {
+	ASSERT (bitmap_test (swap_table, slot));
+	bitmap_reset (swap_table, slot);
+}
+
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
 	struct frame *frame = page->frame;
 	if (page){
+		if (anon_page->swap != NULL) {
+			zswap_free (anon_page->swap);
+			anon_page->swap = NULL;
+		}
 		if(frame){
 			list_remove(&page->copy_elem);
 			frame->write_protected--;
 			if(frame->write_protected == 0){
 				page->frame = NULL;
-				// palloc_free_page(frame->kva);
-				free(frame);
+				vm_free_frame(frame);
 				if(anon_page) {
 					if (anon_page->aux){
 						struct file_info *file_info= (struct file_info *) anon_page->aux;
@@ -126,3 +163,88 @@ anon_destroy (struct page *page) {
 	}
 	return ;
 }
+
+/* Returns the highest page aligned address below STACK_LIMIT and above
+ * the heap where SIZE bytes are unmapped, or NULL if there is none.
+ * Ranges of 2 MiB and more start on a 2 MiB boundary, so that they can
+ * get huge pages. */
+static void *
+anon_find_free_range (size_t size) {
+	struct thread *curr = thread_current ();
+	void *bottom = pg_round_up (curr->heap_end);
+	size_t run = 0;
+
+	for (void *va = (void *) STACK_LIMIT - PGSIZE; va >= bottom && va != NULL;
+			va -= PGSIZE) {
+		if (spt_find_page (&curr->spt, va) != NULL)
+			run = 0;
+		else if ((run += PGSIZE) >= size
+				&& (size < LARGE_PGSIZE || ((uint64_t) va & LARGE_PGMASK) == 0))
+			return va;
+	}
+	return NULL;
+}
+
+/* Do the anonymous mmap: maps LENGTH bytes of zero filled memory at
+ * ADDR, or wherever there is room if ADDR is NULL.  The pages share one
+ * file_info without a file, which marks the range for do_munmap().
+ * Returns the start of the mapping, or NULL on failure. */
+void *
+do_mmap_anon (void *addr, size_t length, int writable) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	size_t size = ROUND_UP (length, PGSIZE);
+	struct file_info *info;
+	void *va;
+
+	if (addr == NULL)
+		addr = anon_find_free_range (size);
+	if (addr == NULL)
+		return NULL;
+	for (va = addr; va < addr + size; va += PGSIZE)
+		if (spt_find_page (spt, va) != NULL)
+			return NULL;
+
+	info = calloc (1, sizeof *info);
+	if (info == NULL)
+		return NULL;
+	info->open_addr = addr;
+	info->close_addr = addr + size;
+	for (va = addr; va < addr + size; va += PGSIZE)
+		if (!vm_alloc_page_with_initializer (VM_ANON, va, writable, NULL, info)) {
+			void *end = va;
+			for (va = addr; va < end; va += PGSIZE)
+				spt_remove_page (spt, spt_find_page (spt, va));
+			free (info);
+			return NULL;
+		}
+	return addr;
+}
+
+/* Do the munmap of the anonymous mapping INFO that starts at ADDR. */
+void
+do_munmap_anon (void *addr, struct file_info *info) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct tlb_batch batch;
+	bool locked;
+
+	if (addr != info->open_addr)
+		return;
+	locked = vm_frame_lock ();
+	tlb_batch_begin (&batch, thread_current ()->pml4);
+	for (void *va = info->open_addr; va < info->close_addr; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page != NULL) {
+			/* Pages copied by fork() carry their own file_info. */
+			struct file_info *page_info = page->anon.aux;
+
+			vm_drop_page (page);
+			spt_remove_page (spt, page);
+			if (page_info != info)
+				free (page_info);
+		}
+	}
+	tlb_batch_finish (&batch);
+	vm_frame_unlock (locked);
+	free (info);
+}
@@ -1,8 +1,11 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include "vm/filemap.h"
 #include "userprog/syscall.h"
 #include "userprog/process.h"
+#include <string.h>
+#include "threads/palloc.h"
 
 static bool file_backed_swap_in(struct page *page, void *kva);
 static bool file_backed_swap_out(struct page *page);
@@ -49,7 +52,7 @@ static bool
 file_backed_swap_out(struct page *page)
 {
 	struct file_page *file_page UNUSED = &page->file;
-	struct thread *page_holder = page->frame->thread;
+	struct thread *page_holder = page->owner;
 	bool is_dirty = pml4_is_dirty(page_holder->pml4, page->va);
 	struct file_info *file_info = page->file.aux;
 	if (is_dirty)
@@ -59,7 +62,7 @@ file_backed_swap_out(struct page *page)
 		if (page->is_writable)
 		{
 			pml4_set_dirty(page_holder->pml4, page->va, 0);
-			file_write_at(file_info->file, page->va, file_info->read_bytes, file_info->ofs);
+			file_write_at(file_info->file, page->frame->kva, file_info->read_bytes, file_info->ofs);
 		}
 		// memcpy(addr, page->frame->kva, file_info->read_bytes);
 		// palloc_free_page(page->frame->kva);
@@ -79,13 +82,15 @@ file_backed_destroy(struct page *page)
 	{
 		if (frame)
 		{
+			/* Other mappings may keep the shared frame, so write our
+			 * changes back now. */
+			file_writeback_page(page);
 			list_remove(&page->copy_elem);
 			frame->write_protected--;
 			if (frame->write_protected == 0)
 			{
 				page->frame = NULL;
-				// palloc_free_page(frame->kva);
-				free(frame);
+				vm_free_frame(frame);
 				if (file_page)
 				{
 					if (file_page->aux)
@@ -104,6 +109,65 @@ file_backed_destroy(struct page *page)
 	}
 }
 
+/* Writes PAGE back to its file if it is resident and dirty in the page
+ * table of its owner. */
+void
+file_writeback_page(struct page *page)
+{
+	struct file_info *file_info = page->file.aux;
+	uint64_t *pml4 = page->owner != NULL ? page->owner->pml4 : NULL;
+
+	if (page->frame == NULL || file_info == NULL || pml4 == NULL
+			|| !page->is_writable)
+		return;
+	if (!pml4_is_dirty(pml4, page->va))
+		return;
+	file_write_at(file_info->file, page->frame->kva, file_info->read_bytes, file_info->ofs);
+	pml4_set_dirty(pml4, page->va, false);
+}
+
+/* Writes PAGE of the running process back to its file if it is a
+ * dirty page of a mapped file, like file_writeback_page(), but meant
+ * for callers that do not hold lock_vm, so that the file system never
+ * waits for a journal commit with that lock held.  The data goes
+ * through BOUNCE, a kernel page, since a fault on user memory inside a
+ * journal operation would wait for lock_vm in turn.  Copying the page
+ * faults it back in if it was evicted, and written, meanwhile. */
+void
+file_writeback_unlocked(struct page *page, void *bounce)
+{
+	struct file_info *file_info = page->file.aux;
+	uint64_t *pml4 = thread_current()->pml4;
+
+	if (VM_TYPE(page->operations->type) != VM_FILE || file_info == NULL
+			|| !page->is_writable || !pml4_is_dirty(pml4, page->va))
+		return;
+	memcpy(bounce, page->va, file_info->read_bytes);
+	pml4_set_dirty(pml4, page->va, false);
+	file_write_at(file_info->file, bounce, file_info->read_bytes, file_info->ofs);
+}
+
+/* Writes the dirty pages of mapped files in [ADDR, END) of the running
+ * process back with file_writeback_unlocked().  Returns false if out
+ * of memory. */
+bool
+file_writeback_range(void *addr, void *end)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	void *bounce = palloc_get_page(0);
+
+	if (bounce == NULL)
+		return false;
+	for (void *va = addr; va < end; va += PGSIZE)
+	{
+		struct page *page = spt_find_page(spt, va);
+		if (page != NULL)
+			file_writeback_unlocked(page, bounce);
+	}
+	palloc_free_page(bounce);
+	return true;
+}
+
 /* Do the mmap */
 void *
 do_mmap(void *addr, size_t length, int writable,
@@ -167,6 +231,12 @@ void do_munmap(void *addr)
 	struct page *page = spt_find_page(&curr->spt, addr);
 	if (page == NULL) return ;
 	struct file_info *file_info = (struct file_info*) page->file.aux;
+	if (file_info == NULL)
+		return;
+	if (file_info->file == NULL) {
+		do_munmap_anon(addr, file_info);
+		return;
+	}
 	if (page->not_present)
 		return;
 	if (addr != file_info->open_addr)
@@ -175,17 +245,14 @@ void do_munmap(void *addr)
 	// printf("check openaddr %p\n", file_info->open_addr);
 	// printf("check close_addr %p\n", file_info->close_addr);
 	void *close_addr = file_info->close_addr;
+	struct tlb_batch batch;
+	/* Write back before taking lock_vm; destroying a page that is still
+	 * dirty, after an out of memory here, writes it with the lock. */
+	file_writeback_range(addr, close_addr);
+	bool locked = vm_frame_lock();
+	tlb_batch_begin(&batch, curr->pml4);
 	while (page->va < close_addr)
 	{
-		bool is_dirty = pml4_is_dirty(curr->pml4, addr);
-		if (is_dirty)
-		{
-			if (page->is_writable)
-			{
-				file_write_at(file_info->file, addr, file_info->read_bytes, file_info->ofs);
-				pml4_set_dirty(curr->pml4, addr, 0);
-			}
-		}
 		spt_remove_page(&curr->spt, page);
 		// if (pml4_get_page(curr->pml4, page->va) != NULL)
 			// pml4_clear_page(curr->pml4, page->va);
@@ -197,8 +264,29 @@ void do_munmap(void *addr)
 	// printf("do munmap check addr %p\n", addr);
 	// printf("file_info->close_addr %p\n", file_info->close_addr);
 	}
+	tlb_batch_finish(&batch);
+	vm_frame_unlock(locked);
 	// lock_acquire(&lock_read);
 
 	// file_close(file_info->file);
 	// lock_release(&lock_read);
-}
\ No newline at end of file
+}
+
+/* Do the msync: writes the dirty pages of mapped files in
+ * [ADDR, ADDR + LENGTH) back, leaving them mapped.  Returns 0 on
+ * success, -1 if ADDR is not page aligned, a page in the range is not
+ * mapped or no bounce page is left. */
+int do_msync(void *addr, size_t length)
+{
+	struct supplemental_page_table *spt = &thread_current()->spt;
+	void *end = addr + length;
+	void *va;
+
+	if (pg_ofs(addr) != 0 || !is_user_vaddr(end) || end < addr)
+		return -1;
+	for (va = addr; va < end; va += PGSIZE)
+		if (spt_find_page(spt, va) == NULL)
+			return -1;
+
+	return file_writeback_range(addr, end) ? 0 : -1;
+}
@@ -0,0 +1,259 @@
+/* filemap.c: Per-inode page cache.
+ *
+ * Maps an (inode, offset) pair to the frame that holds that page of the
+ * file, so that processes loading or mapping the same file share one
+ * frame instead of each reading a private copy.  Two kinds of frames
+ * are cached: read-only text pages, which cannot go stale because a
+ * running executable is write denied, and pages of mmap()ed files,
+ * which all mappings share and write to directly.  read() and write()
+ * on a file go through the cache as well, so they see and update the
+ * mapped pages at once.  A cached frame is shared through its page_list
+ * like a frame shared by fork, and leaves the cache with its last page. */
+
+#include "vm/filemap.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* A cached page of a file. */
+struct filemap_entry {
+	struct hash_elem elem;
+	struct inode *inode;
+	off_t ofs;                  /* Page aligned offset in INODE. */
+	size_t len;                 /* Bytes read from the file, rest zero. */
+	struct frame *frame;
+};
+
+static struct hash filemap;
+static struct lock filemap_lock;
+
+/* Statistics. */
+static long long filemap_hits;
+static long long filemap_misses;
+static long long filemap_read_hits;
+static long long filemap_write_hits;
+
+static uint64_t
+filemap_hash (const struct hash_elem *e_, void *aux UNUSED) {
+	const struct filemap_entry *e = hash_entry (e_, struct filemap_entry, elem);
+	return hash_bytes (&e->inode, sizeof e->inode) ^ hash_int (e->ofs);
+}
+
+static bool
+filemap_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct filemap_entry *a = hash_entry (a_, struct filemap_entry, elem);
+	const struct filemap_entry *b = hash_entry (b_, struct filemap_entry, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+void
+filemap_init (void) {
+	hash_init (&filemap, filemap_hash, filemap_less, NULL);
+	lock_init (&filemap_lock);
+}
+
+/* Returns the entry caching page OFS of INODE, or NULL.  Must be
+ * called with filemap_lock held. */
+static struct filemap_entry *
+filemap_lookup (struct inode *inode, off_t ofs) {
+	struct filemap_entry key;
+	struct hash_elem *e;
+
+	key.inode = inode;
+	key.ofs = ofs;
+	e = hash_find (&filemap, &key.elem);
+	return e != NULL ? hash_entry (e, struct filemap_entry, elem) : NULL;
+}
+
+/* Returns the frame caching the LEN bytes at OFS in INODE, followed by
+ * zeros, with one more sharer counted in its write_protected; the
+ * caller adds its page to the page_list.  Returns NULL if there is no
+ * such frame. */
+struct frame *
+filemap_get (struct inode *inode, off_t ofs, size_t len) {
+	struct filemap_entry *entry;
+	struct frame *frame = NULL;
+
+	lock_acquire (&filemap_lock);
+	entry = filemap_lookup (inode, ofs);
+	/* A frame without sharers is on its way out. */
+	if (entry != NULL && entry->len == len
+			&& entry->frame->write_protected > 0) {
+		frame = entry->frame;
+		frame->write_protected++;
+	}
+	if (frame != NULL)
+		filemap_hits++;
+	else
+		filemap_misses++;
+	lock_release (&filemap_lock);
+	return frame;
+}
+
+/* Caches FRAME, which holds the LEN bytes at OFS in INODE followed by
+ * zeros.  Does nothing if that page is cached already. */
+void
+filemap_add (struct frame *frame, struct inode *inode, off_t ofs,
+		size_t len) {
+	struct filemap_entry *entry = malloc (sizeof *entry);
+
+	if (entry == NULL)
+		return;
+	entry->inode = inode;
+	entry->ofs = ofs;
+	entry->len = len;
+	entry->frame = frame;
+	lock_acquire (&filemap_lock);
+	if (hash_insert (&filemap, &entry->elem) == NULL)
+		frame->cache = entry;
+	else
+		free (entry);
+	lock_release (&filemap_lock);
+}
+
+/* Drops FRAME from the cache, if it is there.  Called before the frame
+ * is freed or reused. */
+void
+filemap_remove (struct frame *frame) {
+	struct filemap_entry *entry = frame->cache;
+
+	if (entry == NULL)
+		return;
+	lock_acquire (&filemap_lock);
+	hash_delete (&filemap, &entry->elem);
+	frame->cache = NULL;
+	lock_release (&filemap_lock);
+	free (entry);
+}
+
+/* Copies the SIZE bytes at POS of INODE that are cached into BOUNCE.
+ * Returns false if they are not all cached. */
+static bool
+filemap_copy_out (struct inode *inode, off_t pos, void *bounce, off_t size) {
+	struct filemap_entry *entry;
+	off_t page_ofs = pos & PGMASK;
+	bool hit = false;
+
+	lock_acquire (&filemap_lock);
+	entry = filemap_lookup (inode, pos - page_ofs);
+	if (entry != NULL && page_ofs + size <= (off_t) entry->len) {
+		memcpy (bounce, entry->frame->kva + page_ofs, size);
+		hit = true;
+	}
+	lock_release (&filemap_lock);
+	return hit;
+}
+
+/* Copies the SIZE bytes in BOUNCE to POS of INODE, as far as that page
+ * is cached. */
+static void
+filemap_copy_in (struct inode *inode, off_t pos, const void *bounce,
+		off_t size) {
+	struct filemap_entry *entry;
+	off_t page_ofs = pos & PGMASK;
+
+	lock_acquire (&filemap_lock);
+	entry = filemap_lookup (inode, pos - page_ofs);
+	if (entry != NULL && page_ofs < (off_t) entry->len) {
+		if (page_ofs + size > (off_t) entry->len)
+			size = entry->len - page_ofs;
+		memcpy (entry->frame->kva + page_ofs, bounce, size);
+		filemap_write_hits++;
+	}
+	lock_release (&filemap_lock);
+}
+
+/* Reads SIZE bytes from FILE into BUFFER, starting at the current
+ * position, like file_read().  Pages that are in the cache are copied
+ * from their frame, which may hold writes through a mapping that did
+ * not reach the disk yet.  Returns the number of bytes read. */
+off_t
+filemap_read (struct file *file, void *buffer_, off_t size) {
+	struct inode *inode = file_get_inode (file);
+	uint8_t *buffer = buffer_;
+	uint8_t *bounce = NULL;
+	off_t pos = file_tell (file);
+	off_t length = inode_length (inode);
+	off_t bytes_read = 0;
+
+	if (hash_empty (&filemap))
+		return file_read (file, buffer, size);
+
+	while (bytes_read < size && pos < length) {
+		off_t chunk = PGSIZE - (pos & PGMASK);
+		if (chunk > size - bytes_read)
+			chunk = size - bytes_read;
+		if (chunk > length - pos)
+			chunk = length - pos;
+
+		/* The frame is copied out under the lock and into the user
+		 * buffer after, which may fault. */
+		if (bounce == NULL)
+			bounce = palloc_get_page (0);
+		if (bounce != NULL && filemap_copy_out (inode, pos, bounce, chunk)) {
+			memcpy (buffer + bytes_read, bounce, chunk);
+			filemap_read_hits++;
+		} else if (inode_read_at (inode, buffer + bytes_read, chunk, pos)
+				!= chunk)
+			break;
+		pos += chunk;
+		bytes_read += chunk;
+	}
+	file_seek (file, pos);
+	if (bounce != NULL)
+		palloc_free_page (bounce);
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into FILE, starting at the current
+ * position, like file_write().  The data goes to the disk and to the
+ * cached frames of the pages written, so that mappings of the file see
+ * it at once.  Returns the number of bytes written. */
+off_t
+filemap_write (struct file *file, const void *buffer_, off_t size) {
+	struct inode *inode = file_get_inode (file);
+	const uint8_t *buffer = buffer_;
+	uint8_t *bounce;
+	off_t pos = file_tell (file);
+	off_t bytes_written = file_write (file, buffer, size);
+	off_t done = 0;
+
+	if (hash_empty (&filemap) || bytes_written <= 0)
+		return bytes_written;
+
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return bytes_written;
+	while (done < bytes_written) {
+		off_t chunk = PGSIZE - (pos & PGMASK);
+		if (chunk > bytes_written - done)
+			chunk = bytes_written - done;
+
+		memcpy (bounce, buffer + done, chunk);
+		filemap_copy_in (inode, pos, bounce, chunk);
+		pos += chunk;
+		done += chunk;
+	}
+	palloc_free_page (bounce);
+	return bytes_written;
+}
+
+/* Prints cache statistics. */
+void
+filemap_print_stats (void) {
+	printf ("Filemap: %lld shared page hits, %lld misses\n",
+			filemap_hits, filemap_misses);
+	printf ("Filemap: %lld read() page hits, %lld write() page updates\n",
+			filemap_read_hits, filemap_write_hits);
+}
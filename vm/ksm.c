@@ -0,0 +1,222 @@
+/* ksm.c: Same-page merging for anonymous frames.
+ *
+ * With the -ksm kernel option, a background thread, ksmd, walks the
+ * frame table a batch of frames at a time and hashes the anonymous
+ * frames that hold a single writable page.  A frame whose hash did not
+ * change since the previous round over the table is stable.
+ * Stable frames with identical contents are merged into one frame
+ * that is write protected for every page on its page_list, exactly
+ * like the frames shared by fork.  The first write to a merged page
+ * breaks the share again through vm_handle_wp(). */
+
+#include "vm/ksm.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Timer ticks between two scan passes. */
+#define KSM_INTERVAL 20
+
+/* Frames looked at by one pass, while holding the frame table lock. */
+#define KSM_BATCH 256
+
+/* Slots of the per-scan hash table.  Must be a power of 2. */
+#define KSM_SLOTS 1024
+
+/* Only every KSM_STRIDE'th word of a page goes into its hash. */
+#define KSM_STRIDE 8
+
+extern struct frame *frame_table;
+extern size_t frame_cnt;
+
+bool ksm_enabled;
+
+/* Stable frames seen in the current round, indexed by hash.  A round
+ * takes several passes, between which the frames may change, so an
+ * entry is checked again before it is used. */
+static struct frame *ksm_slots[KSM_SLOTS];
+
+/* Frame table index where the next pass starts. */
+static size_t ksm_cursor;
+
+/* Statistics. */
+static long long ksm_scanned;     /* Frames hashed. */
+static long long ksm_shared;      /* Frames merged into another one. */
+static long long ksm_unshared;    /* Merged pages copied on write. */
+
+static void ksm_daemon (void *aux);
+static void ksm_scan (void);
+
+/* Starts the merging daemon, if enabled. */
+void
+ksm_init (void) {
+	if (ksm_enabled)
+		thread_create ("ksmd", PRI_MIN, ksm_daemon, NULL);
+}
+
+/* Called by vm_handle_wp() when a page leaves the merged FRAME. */
+void
+ksm_unshare (struct frame *frame) {
+	ASSERT (frame->merged);
+	ksm_unshared++;
+	if (frame->write_protected <= 1)
+		frame->merged = false;
+}
+
+/* Prints merging statistics. */
+void
+ksm_print_stats (void) {
+	printf ("KSM: %lld pages scanned, %lld shared, %lld unshared\n",
+			ksm_scanned, ksm_shared, ksm_unshared);
+}
+
+static void
+ksm_daemon (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (KSM_INTERVAL);
+		ksm_scan ();
+	}
+}
+
+/* Hashes a sample of the words of the page at KVA (FNV-1a). */
+static uint64_t
+ksm_hash_page (const void *kva) {
+	const uint64_t *p = kva;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i += KSM_STRIDE) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/* Returns true if FRAME may be merged away: a fully loaded, writable
+ * anonymous page that nobody else shares. */
+static bool
+ksm_candidate (struct frame *frame) {
+	struct page *page = frame->page;
+
+	return page != NULL
+		&& frame->write_protected == 1
+		&& page->is_writable
+		&& VM_TYPE (page->operations->type) == VM_ANON
+		&& page->owner != NULL && page->owner->pml4 != NULL
+		&& pml4_get_page (page->owner->pml4, page->va) == frame->kva;
+}
+
+/* Returns true if FRAME, found in ksm_slots, can still take the pages
+ * of a frame with the same contents. */
+static bool
+ksm_target (struct frame *frame) {
+	return frame->allocated && !frame->pinned
+		&& (frame->merged || ksm_candidate (frame));
+}
+
+/* Write protects every mapping of FRAME, so that no user write
+ * changes it between a comparison and the merge.  A frame that is not
+ * merged after all gets writable again on its next write fault. */
+static void
+ksm_protect (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->page_list); e != list_end (&frame->page_list);
+			e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, copy_elem);
+		uint64_t *pml4 = p->owner != NULL ? p->owner->pml4 : NULL;
+		if (pml4 != NULL && pml4_get_page (pml4, p->va) != NULL)
+			pml4_set_writable (pml4, p->va, false);
+	}
+}
+
+/* Moves the only page of VICTIM onto TARGET, write protects every
+ * mapping of TARGET and frees VICTIM. */
+static void
+ksm_merge (struct frame *victim, struct frame *target) {
+	struct page *page = victim->page;
+	struct list_elem *e;
+
+	list_remove (&page->copy_elem);
+	list_push_back (&target->page_list, &page->copy_elem);
+	target->write_protected++;
+	target->merged = true;
+	page->frame = target;
+
+	for (e = list_begin (&target->page_list); e != list_end (&target->page_list);
+			e = list_next (e)) {
+		struct page *p = list_entry (e, struct page, copy_elem);
+		uint64_t *pml4 = p->owner != NULL ? p->owner->pml4 : NULL;
+		if (pml4 != NULL && pml4_get_page (pml4, p->va) != NULL)
+			pml4_set_page (pml4, p->va, target->kva, false);
+	}
+
+	vm_free_frame (victim);
+	ksm_shared++;
+}
+
+/* Looks at the next KSM_BATCH frames of the frame table and merges
+ * identical stable frames.  Holds the frame table lock, so that no
+ * fault or eviction changes a frame under us; only the sampled hashes
+ * and the (rare) comparisons of equal hashes are done here.  User
+ * threads may still write to their pages meanwhile, so both frames are
+ * write protected before they are compared. */
+static void
+ksm_scan (void) {
+	bool locked = vm_frame_lock ();
+	size_t end;
+
+	if (ksm_cursor >= frame_cnt)
+		ksm_cursor = 0;
+	if (ksm_cursor == 0)
+		memset (ksm_slots, 0, sizeof ksm_slots);
+	end = ksm_cursor + KSM_BATCH < frame_cnt
+		? ksm_cursor + KSM_BATCH : frame_cnt;
+	for (size_t idx = ksm_cursor; idx < end; idx++) {
+		struct frame *frame = &frame_table[idx];
+		uint64_t hash;
+		bool stable;
+
+		if (!frame->allocated || frame->pinned)
+			continue;
+		if (!frame->merged && !ksm_candidate (frame))
+			continue;
+
+		hash = ksm_hash_page (frame->kva);
+		stable = hash == frame->checksum;
+		frame->checksum = hash;
+		ksm_scanned++;
+		if (!stable)
+			continue;
+
+		for (size_t i = hash % KSM_SLOTS, n = 0; n < KSM_SLOTS;
+				i = (i + 1) % KSM_SLOTS, n++) {
+			struct frame *other = ksm_slots[i];
+
+			if (other == NULL || other == frame || !ksm_target (other)) {
+				ksm_slots[i] = frame;
+				break;
+			}
+			if (other->checksum != hash)
+				continue;
+			ksm_protect (frame);
+			ksm_protect (other);
+			if (memcmp (other->kva, frame->kva, PGSIZE))
+				continue;
+
+			if (ksm_candidate (frame))
+				ksm_merge (frame, other);
+			else if (ksm_candidate (other)) {
+				ksm_merge (other, frame);
+				ksm_slots[i] = frame;
+			}
+			break;
+		}
+	}
+	ksm_cursor = end;
+	vm_frame_unlock (locked);
+}
@@ -1,5 +1,9 @@
 vm_SRC = vm/vm.c          # Main api proxy
 vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
+vm_SRC += vm/zswap.c      # Compressed swap tier
+vm_SRC += vm/ksm.c        # Same-page merging
+vm_SRC += vm/filemap.c    # Frames shared by file offset
+vm_SRC += vm/thp.c        # Transparent huge pages
 vm_SRC += vm/file.c       # File mapped page
 vm_SRC += vm/inspect.c    # Testing utility
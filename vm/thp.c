@@ -0,0 +1,135 @@
+/* thp.c: Transparent huge pages for anonymous memory.
+ *
+ * The first fault on a fresh anonymous page whose whole 2 MiB aligned
+ * neighbourhood consists of fresh, writable anonymous pages, and has
+ * nothing mapped yet, maps all 512 pages at once: they get frames out
+ * of one aligned run of user pool pages, which a single page directory
+ * entry with PTE_PS maps.
+ *
+ * Every page still has its own struct page and struct frame, so the
+ * rest of the VM treats them like any other anonymous page.  The
+ * first change to the mapping of a single page (munmap, copy on write,
+ * eviction) makes threads/mmu.c split the 2 MiB page into a page table
+ * of 4 kB pages that point to the same frames. */
+
+#include "vm/thp.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* 4 kB pages in a 2 MiB page. */
+#define THP_PAGES (LARGE_PGSIZE / PGSIZE)
+
+bool thp_enabled;
+
+/* Statistics. */
+static long long thp_mapped;     /* 2 MiB pages mapped. */
+static long long thp_fallback;   /* Eligible ranges without memory. */
+
+/* Returns true if every page of the 2 MiB range at BASE is a fresh,
+ * writable anonymous page and nothing in the range is mapped yet. */
+static bool
+thp_eligible (struct thread *t, void *base) {
+	uint64_t *pde = pml4_pde_walk (t->pml4, (uint64_t) base, false);
+
+	if (!is_user_vaddr (base + LARGE_PGSIZE - 1))
+		return false;
+	if (pde != NULL && *pde != 0)
+		return false;
+	for (size_t i = 0; i < THP_PAGES; i++) {
+		struct page *page = spt_find_page (&t->spt, base + i * PGSIZE);
+
+		if (page == NULL || !page->is_writable || !vm_is_fresh_anon (page))
+			return false;
+	}
+	return true;
+}
+
+/* Takes the frames back from the first CNT pages of the range at BASE,
+ * which got frames from the run at KVA before one failed to load, and
+ * frees the run.  The range is not mapped yet; the pages that did load
+ * are plain anonymous pages now, which the 4 kB path zero fills again. */
+static void
+thp_undo (struct thread *t, void *base, uint8_t *kva, size_t cnt) {
+	for (size_t i = 0; i < cnt; i++) {
+		struct page *p = spt_find_page (&t->spt, base + i * PGSIZE);
+		struct frame *frame = vm_frame_of (kva + i * PGSIZE);
+
+		list_remove (&p->copy_elem);
+		p->frame = NULL;
+		p->not_present = true;
+		frame->page = NULL;
+		frame->thread = NULL;
+		frame->write_protected = 0;
+		frame->allocated = false;
+	}
+	palloc_free_multiple (kva, THP_PAGES);
+}
+
+/* Tries to map the 2 MiB range around PAGE, which faulted, as one huge
+ * page.  Returns false, without changing anything, if the range is not
+ * eligible or no aligned run of user pages is free. */
+bool
+thp_try_fault (struct page *page) {
+	struct thread *t = thread_current ();
+	void *base = (void *) ((uint64_t) page->va & ~LARGE_PGMASK);
+	uint64_t *pde = NULL;
+	uint8_t *kva;
+
+	if (!thp_eligible (t, base))
+		return false;
+
+	kva = palloc_get_aligned (PAL_USER, THP_PAGES);
+	if (kva != NULL)
+		pde = pml4_pde_walk (t->pml4, (uint64_t) base, true);
+	if (pde == NULL) {
+		if (kva != NULL)
+			palloc_free_multiple (kva, THP_PAGES);
+		thp_fallback++;
+		return false;
+	}
+
+	for (size_t i = 0; i < THP_PAGES; i++) {
+		struct page *p = spt_find_page (&t->spt, base + i * PGSIZE);
+		struct frame *frame = vm_frame_of (kva + i * PGSIZE);
+		bool loaded;
+
+		frame->allocated = true;
+		frame->pinned = false;
+		frame->page = p;
+		frame->thread = t;
+		list_push_back (&frame->page_list, &p->copy_elem);
+		frame->write_protected = 1;
+		frame->merged = false;
+		frame->checksum = 0;
+		frame->cache = NULL;
+		frame->tested = false;
+		frame->spared = false;
+
+		p->frame = frame;
+		p->not_present = false;
+		p->zero_mapped = false;
+		loaded = swap_in (p, frame->kva);
+		if (!loaded) {
+			thp_undo (t, base, kva, i + 1);
+			thp_fallback++;
+			return false;
+		}
+	}
+
+	/* Map the range only now, so nothing sees a half set up page. */
+	*pde = vtop (kva) | PTE_P | PTE_W | PTE_U | PTE_PS;
+	thp_mapped++;
+	return true;
+}
+
+/* Prints huge page statistics. */
+void
+thp_print_stats (void) {
+	printf ("THP: %lld huge pages mapped, %lld fallbacks\n",
+			thp_mapped, thp_fallback);
+}
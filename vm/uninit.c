@@ -75,7 +75,9 @@ uninit_destroy(struct page *page)
 		}
 	}
 	if (page->frame){
-		free(page->frame);
+		list_remove(&page->copy_elem);
+		if (--page->frame->write_protected == 0)
+			vm_free_frame(page->frame);
 		page->frame = NULL;
 	}
 	return;
@@ -1,20 +1,52 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
 #include "threads/malloc.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/filemap.h"
+#include "vm/thp.h"
 #include "threads/mmu.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
 // #include "lib/kernel/list.h"
 
 static void page_destroy(const struct hash_elem *p_, void *aux UNUSED);
-static void frame_table_next(struct list *list);
 
-struct list frame_table;
-struct list_elem *start;
+/* The frame table: one entry for every page of the user pool, in
+ * physical order, so that the frame of a kva is found by indexing. */
+struct frame *frame_table;
+size_t frame_cnt;
+static uint8_t *frame_base;
+
+/* Next frame the clock looks at for eviction. */
+static size_t clock_hand;
+
+/* Frame replacement policy, see vm_get_victim(). */
+enum vm_evict_policy vm_evict_policy = EVICT_CLOCK;
+
+/* Frames in the hot set of the 2Q policy, and their upper bound. */
+static size_t hot_cnt;
+#define HOT_MAX (frame_cnt * 3 / 4)
+
+/* Statistics. */
+static long long evict_clean;     /* Frames evicted without a write. */
+static long long evict_dirty;     /* Frames written to swap or file. */
+
+/* Serializes faults, eviction and every other change to the frame
+ * table or to the page lists of frames.  A fault releases it while it
+ * reads or writes a pinned frame, see vm_io_begin(). */
 struct lock lock_vm;
 
+/* Signalled with lock_vm when a frame filled or written out with the
+ * lock released is done. */
+static struct condition vm_io_done;
+
+/* Read-only frame of zeros, shared by every anonymous page that has
+ * been read but never written. */
+static void *zero_kva;
+
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -29,9 +61,19 @@ vm_init (void) {
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
-	start = NULL;
 	lock_init(&lock_vm);
-	list_init(&frame_table);
+	cond_init (&vm_io_done);
+	palloc_user_pool ((void **) &frame_base, &frame_cnt);
+	frame_table = calloc (frame_cnt, sizeof *frame_table);
+	if (frame_table == NULL)
+		PANIC ("vm: no memory for the frame table");
+	for (size_t i = 0; i < frame_cnt; i++) {
+		frame_table[i].kva = frame_base + i * PGSIZE;
+		list_init (&frame_table[i].page_list);
+	}
+	zero_kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	filemap_init ();
+	ksm_init ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -51,6 +93,8 @@ page_get_type (struct page *page) {
 /* Helpers */
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
+static void vm_link_frame (struct page *page, struct frame *frame);
+static bool vm_fill_frame (struct page *page, struct frame *frame);
 static struct frame *vm_evict_frame (void);
 
 /* Create the pending page object with initializer. If you want to create a
@@ -88,6 +132,8 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		uninit_new (new_pg, upage, init, type, aux, initializer);
 		new_pg->is_writable = writable;
 		new_pg->not_present = true;
+		new_pg->owner = thread_current ();
+		new_pg->advice = MADV_NORMAL;
 		spt_insert_page(spt, new_pg);
 	}
 	else goto err;
@@ -99,10 +145,10 @@ err:
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *
 spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = (struct page*)malloc(sizeof(struct page));
-	page->va = pg_round_down(va);
-	struct hash_elem *e = hash_find(&spt->spt_hash, &page->hash_elem);	
-	free(page);
+	/* Lookup key; page_hash() and page_less() only read its va. */
+	struct page key;
+	key.va = pg_round_down(va);
+	struct hash_elem *e = hash_find(&spt->spt_hash, &key.hash_elem);
 	if (e == NULL){
 		return NULL;
 	}
@@ -124,85 +170,345 @@ spt_insert_page (struct supplemental_page_table *spt UNUSED,
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
 	if (hash_empty(&spt->spt_hash)) return;
-	if(hash_delete(&spt->spt_hash, &page->hash_elem))
+	if(hash_delete(&spt->spt_hash, &page->hash_elem)) {
+		/* Unmap it, so it faults instead of reaching a freed frame. */
+		if (page->owner != NULL && page->owner->pml4 != NULL)
+			pml4_clear_page (page->owner->pml4, page->va);
 		vm_dealloc_page (page);
+	}
 	return;
 }
 
-/* Get the struct frame, that will be evicted. */
-static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-	// if(start == NULL)
-	// 	start = list_begin(&frame_table);
-	while (1) {
-		frame_table_next(&frame_table);
-		victim = list_entry(start, struct frame, list_e);
-		if (pml4_is_accessed(victim->thread->pml4, victim->page->va)){
-			pml4_set_accessed(victim->thread->pml4, victim->page->va, false);
-			continue;
+/* Returns the frame of the user pool page at KVA. */
+struct frame *
+vm_frame_of (void *kva) {
+	size_t idx = ((uint8_t *) kva - frame_base) / PGSIZE;
+
+	ASSERT ((uint8_t *) kva >= frame_base && idx < frame_cnt);
+	return &frame_table[idx];
+}
+
+/* Acquires the frame table lock unless the running thread holds it
+ * already, as when a fault hits a user buffer that munmap() writes
+ * back.  Pages of the running thread that another thread is evicting
+ * with the lock released are waited for, so that the caller finds
+ * every page of its own either resident or swapped out.  Returns true
+ * if it was acquired, for vm_frame_unlock(). */
+bool
+vm_frame_lock (void) {
+	struct thread *t = thread_current ();
+
+	if (lock_held_by_current_thread (&lock_vm))
+		return false;
+	lock_acquire (&lock_vm);
+	while (t->vm_io_cnt > 0)
+		cond_wait (&vm_io_done, &lock_vm);
+	return true;
+}
+
+/* Releases the frame table lock if LOCKED. */
+void
+vm_frame_unlock (bool locked) {
+	if (locked)
+		lock_release (&lock_vm);
+}
+
+/* Releases the frame table lock for disk or file I/O on a frame that
+ * the caller pinned, if the running thread took the lock for a fault
+ * of its own.  Any other holder keeps it, since it may rely on the
+ * frame table staying as it is.  Returns true if the lock was
+ * released, for vm_io_end(). */
+static bool
+vm_io_begin (void) {
+	struct thread *t = thread_current ();
+
+	if (!t->vm_io_unlock)
+		return false;
+	t->vm_io_unlock = false;
+	lock_release (&lock_vm);
+	return true;
+}
+
+/* With lock_vm taken back after vm_io_begin(), waits like
+ * vm_frame_lock() for pages of the running thread that got evicted
+ * meanwhile, since the caller may go on with other pages of its own. */
+static void
+vm_io_resume (void) {
+	struct thread *t = thread_current ();
+
+	while (t->vm_io_cnt > 0)
+		cond_wait (&vm_io_done, &lock_vm);
+	t->vm_io_unlock = true;
+}
+
+/* Takes the frame table lock back after vm_io_begin().  The caller
+ * signals vm_io_done once its frame is unpinned. */
+static void
+vm_io_end (bool released) {
+	if (!released)
+		return;
+	lock_acquire (&lock_vm);
+	vm_io_resume ();
+}
+
+/* Returns FRAME, which no page uses anymore, to the user pool. */
+void
+vm_free_frame (struct frame *frame) {
+	filemap_remove (frame);
+	frame->page = NULL;
+	frame->thread = NULL;
+	frame->write_protected = 0;
+	frame->merged = false;
+	frame->pinned = false;
+	frame->allocated = false;
+	if (frame->hot)
+		hot_cnt--;
+	frame->hot = false;
+	palloc_free_page (frame->kva);
+}
+
+/* Returns true if a page of FRAME was accessed through any of the
+ * page tables that map it, and clears the accessed bits. */
+static bool
+vm_frame_test_accessed (struct frame *frame) {
+	bool accessed = false;
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->page_list); e != list_end (&frame->page_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, copy_elem);
+		uint64_t *pml4 = page->owner != NULL ? page->owner->pml4 : NULL;
+
+		if (pml4 != NULL && pml4_is_accessed (pml4, page->va)) {
+			pml4_set_accessed (pml4, page->va, false);
+			accessed = true;
 		}
-		break ;
 	}
-	return victim;
+	return accessed;
+}
+
+/* Returns true if PAGE is a loaded read-only page of an executable.
+ * Its content is still that of the file, so eviction drops it instead
+ * of swapping it out, and it faults back in through the page cache. */
+static bool
+vm_is_text_page (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_ANON
+		&& page->anon.init == lazy_load_segment && !page->is_writable
+		&& page->anon.swap == NULL;
 }
-static
-void frame_table_next(struct list *list){
-	start = start->next;
-	if (list_tail(list) == start)
-		start = list_begin(list);
+
+/* Returns true if evicting FRAME costs no write: every page on it is
+ * executable text or a file page that is clean in the page table of its
+ * owner. */
+static bool
+vm_frame_is_clean (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->page_list); e != list_end (&frame->page_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, copy_elem);
+		uint64_t *pml4 = page->owner != NULL ? page->owner->pml4 : NULL;
+
+		if (vm_is_text_page (page))
+			continue;
+		if (VM_TYPE (page->operations->type) != VM_FILE)
+			return false;
+		if (pml4 != NULL && pml4_is_dirty (pml4, page->va))
+			return false;
+	}
+	return true;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+/* Returns true if evicting FRAME writes a page back to its file.  Only
+ * a thread that releases lock_vm for the write evicts such a frame, so
+ * that the file system never waits for a journal commit with the lock
+ * held. */
+static bool
+vm_frame_writes_file (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->page_list); e != list_end (&frame->page_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, copy_elem);
+		uint64_t *pml4 = page->owner != NULL ? page->owner->pml4 : NULL;
+
+		if (VM_TYPE (page->operations->type) == VM_FILE && page->is_writable
+				&& pml4 != NULL && pml4_is_dirty (pml4, page->va))
+			return true;
+	}
+	return false;
+}
+
+/* Victim selection of the 2Q policy, a clock over two sets.  A frame
+ * starts cold; the first sweep only consumes the access of the fault
+ * that loaded it, and a cold frame found accessed again on a later
+ * sweep turns hot.  Hot frames are never evicted, they turn cold when
+ * a sweep finds them unused.  A page touched once by a scan thus
+ * leaves after two sweeps, without pushing the working set of other
+ * processes out.  Among cold frames, those that need a write to swap
+ * or to their file are passed over once, so clean file pages go
+ * first.  Accessed bits of every page sharing a frame count. */
 static struct frame *
-vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	// /* TODO: swap out the victim and return the evicted frame. */
+vm_get_victim_2q (void) {
+	ASSERT (lock_held_by_current_thread (&lock_vm));
+	for (size_t n = 0; n < 4 * frame_cnt; n++) {
+		struct frame *victim = &frame_table[clock_hand];
+		bool accessed;
 
-	if (victim){
-		if (&victim->page_list == NULL) return NULL;
-		list_remove(&victim->list_e);
-		list_init(&victim->page_list);
+		clock_hand = (clock_hand + 1) % frame_cnt;
+		if (!victim->allocated || victim->pinned || victim->page == NULL)
+			continue;
+		if (!thread_current ()->vm_io_unlock && vm_frame_writes_file (victim))
+			continue;
+		accessed = vm_frame_test_accessed (victim);
+		if (victim->hot) {
+			if (!accessed) {
+				victim->hot = false;
+				hot_cnt--;
+			}
+			continue;
+		}
+		if (accessed && victim->page->advice != MADV_SEQUENTIAL) {
+			victim->spared = false;
+			if (victim->tested && hot_cnt < HOT_MAX) {
+				victim->hot = true;
+				hot_cnt++;
+			}
+			victim->tested = true;
+			continue;
+		}
+		if (!victim->spared && !vm_frame_is_clean (victim)) {
+			victim->spared = true;
+			continue;
+		}
 		return victim;
 	}
 	return NULL;
 }
 
-/* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+/* Get the struct frame, that will be evicted: runs the clock over the
+ * frame table, or the 2Q policy if selected.  Pinned frames are passed
+ * over, and so are frames shared by several pages (fork, merged or
+ * cached text) unless nothing else is left.  Returns NULL if every
+ * frame is pinned. */
+static struct frame *
+vm_get_victim (void) {
+	size_t skipped = 0;
+
+	if (vm_evict_policy == EVICT_2Q)
+		return vm_get_victim_2q ();
 
+	ASSERT (lock_held_by_current_thread (&lock_vm));
+	for (size_t n = 0; n < 4 * frame_cnt; n++) {
+		struct frame *victim = &frame_table[clock_hand];
+		uint64_t *pml4;
+
+		clock_hand = (clock_hand + 1) % frame_cnt;
+		if (!victim->allocated || victim->pinned || victim->page == NULL)
+			continue;
+		if (!thread_current ()->vm_io_unlock && vm_frame_writes_file (victim))
+			continue;
+		if (victim->write_protected > 1 && skipped++ < 2 * frame_cnt)
+			continue;
+		pml4 = victim->page->owner != NULL ? victim->page->owner->pml4 : NULL;
+		/* Sequentially accessed pages get no second chance. */
+		if (pml4 != NULL && victim->page->advice != MADV_SEQUENTIAL
+				&& pml4_is_accessed (pml4, victim->page->va)) {
+			pml4_set_accessed (pml4, victim->page->va, false);
+			continue;
+		}
+		return victim;
+	}
+	return NULL;
+}
+
+/* Evict one frame and return it, pinned.  Every page on its page list
+ * is swapped out, not only the one the frame points to, except for
+ * executable text, which is only unmapped: all its sharers find it in
+ * the page cache again, as one frame, instead of as one swapped out
+ * copy each.
+ * The writes to swap or to the file may run with lock_vm released: the
+ * pages are unmapped first, and their owners wait in vm_frame_lock()
+ * until they are written, so nobody else touches them meanwhile.
+ * Return NULL on error.*/
 static struct frame *
-vm_get_frame(void)
-{
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
-	void *new_kva = palloc_get_page(PAL_USER);
-	if (new_kva == NULL)
-	{
-		frame = vm_evict_frame();
-		swap_out(frame->page);
-		frame->thread = NULL;
-		if (frame == NULL) return NULL;
+vm_evict_frame (void) {
+	struct frame *victim = vm_get_victim ();
+	struct list evicted;
+	struct list_elem *e;
+	bool released;
+
+	if (victim == NULL)
+		return NULL;
+	victim->pinned = true;
+	if (vm_frame_is_clean (victim))
+		evict_clean++;
+	else
+		evict_dirty++;
+	filemap_remove (victim);
+	for (e = list_begin (&victim->page_list); e != list_end (&victim->page_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, copy_elem);
+
+		if (page->owner != thread_current ())
+			page->owner->vm_io_cnt++;
+		if (page->owner->pml4 != NULL)
+			pml4_clear_page (page->owner->pml4, page->va);
 	}
-	else{
-		frame = (struct frame *)malloc(sizeof(struct frame));
-		frame->kva = new_kva;
-		list_init(&frame->page_list);
+
+	list_init (&evicted);
+	released = vm_io_begin ();
+	while (!list_empty (&victim->page_list)) {
+		struct page *page = list_entry (list_pop_front (&victim->page_list),
+				struct page, copy_elem);
+		if (vm_is_text_page (page)) {
+			page->anon.dropped = true;
+			page->frame = NULL;
+		} else if (!swap_out (page))
+			PANIC ("vm: out of swap space");
+		list_push_back (&evicted, &page->copy_elem);
+	}
+	if (released)
+		lock_acquire (&lock_vm);
+	while (!list_empty (&evicted)) {
+		struct page *page = list_entry (list_pop_front (&evicted),
+				struct page, copy_elem);
+		if (page->owner != thread_current ())
+			page->owner->vm_io_cnt--;
 	}
-	start = &frame->list_e;
-	list_push_back(&frame_table, &frame->list_e);
+	cond_broadcast (&vm_io_done, &lock_vm);
+	if (released)
+		vm_io_resume ();
+	return victim;
+}
+
+/* palloc() and get frame. If there is no available page, evict the page
+ * and return it.  The frame comes back pinned; the caller unpins it
+ * once its content is in place.  Returns NULL if the user pool is full
+ * and nothing can be evicted. */
+static struct frame *
+vm_get_frame (void) {
+	struct frame *frame;
+	void *kva;
+
+	ASSERT (lock_held_by_current_thread (&lock_vm));
+	kva = palloc_get_page (PAL_USER);
+	frame = kva != NULL ? vm_frame_of (kva) : vm_evict_frame ();
+	if (frame == NULL)
+		return NULL;
+
+	frame->allocated = true;
+	frame->pinned = true;
 	frame->page = NULL;
-	frame->thread = thread_current();
-	/*
-	TODO : if user pool memory is full, do evict.
-	*/
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
-	
+	frame->thread = thread_current ();
+	frame->write_protected = 0;
+	frame->merged = false;
+	frame->checksum = 0;
+	frame->cache = NULL;
+	frame->tested = false;
+	frame->spared = false;
+	ASSERT (!frame->hot);
+	ASSERT (list_empty (&frame->page_list));
 	return frame;
 }
 
@@ -229,26 +535,337 @@ vm_handle_wp (struct page *page UNUSED) {
 	struct frame *old_frame = page->frame;
 	struct thread *cur = thread_current();
 
-	page->frame = NULL;
-	list_remove(&page->copy_elem);
-	pml4_clear_page(cur->pml4, page->va);
+	if (!page->is_writable)
+		return false;
+	/* Every other sharer is gone, the frame is ours to write.  Pages of
+	 * a mapped file share their cached frame for writing as well. */
+	if (old_frame->write_protected == 1
+			|| (old_frame->cache != NULL && page_get_type (page) == VM_FILE)) {
+		old_frame->merged = false;
+		return pml4_set_page (cur->pml4, page->va, old_frame->kva, true);
+	}
 
+	/* Keep the source of the copy from being evicted for the new frame.
+	 * The page stays a sharer until the copy is made, so that no other
+	 * sharer takes the frame over for writing meanwhile, even if
+	 * vm_get_frame() releases lock_vm to evict. */
+	old_frame->pinned = true;
+	struct frame *frame = vm_get_frame ();
+	old_frame->pinned = false;
+	if (frame == NULL)
+		return false;
+	memcpy(frame->kva, old_frame->kva, PGSIZE);
+
+	list_remove(&page->copy_elem);
 	old_frame->write_protected--;
+	if (old_frame->merged)
+		ksm_unshare (old_frame);
 	if(old_frame->page == page){
 		old_frame->page = list_entry(list_begin(&old_frame->page_list), struct page, copy_elem);
 	}
-	if (vm_do_claim_page(page)){
-		memcpy(page->frame->kva, old_frame->kva, PGSIZE);
+
+	frame->page = page;
+	frame->write_protected = 1;
+	list_push_back (&frame->page_list, &page->copy_elem);
+	page->frame = frame;
+	frame->pinned = false;
+	cond_broadcast (&vm_io_done, &lock_vm);
+	return pml4_set_page (cur->pml4, page->va, frame->kva, true);
+}
+
+/* Returns true if PAGE is a file page not resident whose frame is
+ * kept in the page cache: a page of an mmap()ed file or a read-only
+ * page of an executable, loaded before or not.  Writable executable
+ * pages stay private. */
+static bool
+vm_is_cached_page (struct page *page) {
+	if (VM_TYPE (page->operations->type) == VM_FILE)
+		return page->file.aux != NULL;
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		return vm_is_text_page (page);
+	if (VM_TYPE (page->operations->type) != VM_UNINIT
+			|| page->uninit.init != lazy_load_segment)
+		return false;
+	return VM_TYPE (page->uninit.type) == VM_FILE || !page->is_writable;
+}
+
+/* Claims PAGE on the cached frame that holds the same offset of the
+ * same file for another process, or loads it and caches the new frame
+ * for the next one.  A mapped file page or executable text evicted or
+ * dropped before comes back to the cache this way too, so that all
+ * mappings keep sharing. */
+static bool
+vm_claim_cached_page (struct page *page) {
+	enum vm_type type = VM_TYPE (page->operations->type);
+	bool uninit = type == VM_UNINIT;
+	struct file_info *file_info = uninit ? page->uninit.aux
+		: type == VM_FILE ? page->file.aux : page->anon.aux;
+	struct inode *inode = file_get_inode (file_info->file);
+	struct frame *frame;
+
+	frame = filemap_get (inode, file_info->ofs, file_info->read_bytes);
+	if (frame == NULL) {
+		struct frame *new_frame = vm_get_frame ();
+
+		if (new_frame == NULL)
+			return false;
+		/* Eviction may have released lock_vm, and another process
+		 * cached the page meanwhile. */
+		frame = filemap_get (inode, file_info->ofs, file_info->read_bytes);
+		if (frame == NULL) {
+			vm_link_frame (page, new_frame);
+			filemap_add (new_frame, inode, file_info->ofs,
+					file_info->read_bytes);
+			return vm_fill_frame (page, new_frame);
+		}
+		vm_free_frame (new_frame);
+	}
+
+	/* Transmute the page as uninit_initialize() does, minus the read.
+	 * filemap_get() already counted the page in write_protected. */
+	if (uninit)
+		page->uninit.page_initializer (page, page->uninit.type, frame->kva);
+	page->frame = frame;
+	list_push_back (&frame->page_list, &page->copy_elem);
+	page->not_present = false;
+
+	/* Another fault is still reading the frame in.  If it gets evicted
+	 * right after, the page was swapped out with it and faults again. */
+	while (frame->pinned && page->frame == frame)
+		cond_wait (&vm_io_done, &lock_vm);
+	if (page->frame != frame)
 		return true;
-	} else {
-		// printf("check do_claim_fail\n");
+	if (frame->cache == NULL) {
+		/* The read failed. */
+		list_remove (&page->copy_elem);
+		frame->write_protected--;
+		page->frame = NULL;
+		page->not_present = true;
 		return false;
 	}
+	return pml4_set_page (thread_current ()->pml4, page->va, frame->kva,
+			page->is_writable);
 }
 
-/* Return true on success */
+/* Pages read ahead of a fault in a MADV_SEQUENTIAL range. */
+#define READAHEAD_PAGES 8
+/* Distance behind a fault in a MADV_SEQUENTIAL range at which file
+ * pages are dropped. */
+#define DROP_BEHIND_PAGES 16
+
+/* Returns true if PAGE is not resident and its content comes from a
+ * file, so that loading it ahead of time saves a disk wait later. */
+static bool
+vm_is_file_backed (struct page *page) {
+	if (page->frame != NULL)
+		return false;
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		return page->uninit.init == lazy_load_segment;
+	return VM_TYPE (page->operations->type) == VM_FILE;
+}
+
+/* Loads PAGE, which is not resident. */
+static bool
+vm_load_page (struct page *page) {
+	if (vm_is_cached_page (page))
+		return vm_claim_cached_page (page);
+	if (page->zero_mapped)
+		pml4_clear_page (thread_current ()->pml4, page->va);
+	return vm_do_claim_page (page);
+}
+
+/* Detaches PAGE from its frame and unmaps it.  A dirty page of a mapped
+ * file is written back first.  The frame is freed with its last page;
+ * the next access faults the page in again, from the file or the
+ * executable it was loaded from or, for any other anonymous page, as
+ * zeros. */
+void
+vm_drop_page (struct page *page) {
+	struct thread *cur = thread_current ();
+	struct frame *frame = page->frame;
+
+	if (page->zero_mapped) {
+		pml4_clear_page (cur->pml4, page->va);
+		page->zero_mapped = false;
+	}
+	if (frame == NULL)
+		return;
+
+	if (page_get_type (page) == VM_FILE) {
+		/* Written back with lock_vm released if the caller allows it,
+		 * as a fault dropping pages behind a sequential read does. */
+		bool released;
+
+		frame->pinned = true;
+		released = vm_io_begin ();
+		file_writeback_page (page);
+		vm_io_end (released);
+		frame->pinned = false;
+	} else if (VM_TYPE (page->operations->type) == VM_ANON) {
+		if (page->anon.swap != NULL) {
+			zswap_free (page->anon.swap);
+			page->anon.swap = NULL;
+		}
+		page->anon.dropped = true;
+	}
+	pml4_clear_page (cur->pml4, page->va);
+	page->frame = NULL;
+	list_remove (&page->copy_elem);
+	if (--frame->write_protected > 0) {
+		if (frame->page == page)
+			frame->page = list_entry (list_begin (&frame->page_list),
+					struct page, copy_elem);
+		return;
+	}
+	vm_free_frame (frame);
+}
+
+/* Called after PAGE in a MADV_SEQUENTIAL range was faulted in: reads the
+ * following file pages ahead and drops the file page far behind. */
+static void
+vm_sequential_fault (struct page *page) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *p;
+
+	for (int i = 1; i <= READAHEAD_PAGES; i++) {
+		p = spt_find_page (spt, page->va + i * PGSIZE);
+		if (p == NULL || p->advice != MADV_SEQUENTIAL)
+			break;
+		if (vm_is_file_backed (p) && !vm_load_page (p))
+			break;
+	}
+
+	if (page->va < (void *) (DROP_BEHIND_PAGES * PGSIZE))
+		return;
+	p = spt_find_page (spt, page->va - DROP_BEHIND_PAGES * PGSIZE);
+	if (p != NULL && p->advice == MADV_SEQUENTIAL && p->frame != NULL
+			&& page_get_type (p) == VM_FILE)
+		vm_drop_page (p);
+}
+
+/* Applies ADVICE to the pages in [ADDR, ADDR + LENGTH).  MADV_NORMAL,
+ * MADV_RANDOM and MADV_SEQUENTIAL are remembered by the pages and used
+ * on faults and eviction.  MADV_WILLNEED loads the pages that come from
+ * a file right away, MADV_DONTNEED frees the frames of the pages.
+ * Returns 0 on success, -1 if ADDR is not page aligned, a page in the
+ * range is not mapped or ADVICE is unknown. */
+int
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct tlb_batch batch;
+	void *end = addr + length;
+	void *va;
+	bool locked;
+
+	if (pg_ofs (addr) != 0 || advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return -1;
+	if (!is_user_vaddr (addr) || !is_user_vaddr (end) || end < addr)
+		return -1;
+	for (va = addr; va < end; va += PGSIZE)
+		if (spt_find_page (spt, va) == NULL)
+			return -1;
+	/* Dropped pages of mapped files are written back without lock_vm. */
+	if (advice == MADV_DONTNEED)
+		file_writeback_range (addr, end);
+
+	locked = vm_frame_lock ();
+	tlb_batch_begin (&batch, thread_current ()->pml4);
+	for (va = addr; va < end; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		switch (advice) {
+			case MADV_WILLNEED:
+				if (vm_is_file_backed (page))
+					vm_load_page (page);
+				break;
+			case MADV_DONTNEED:
+				vm_drop_page (page);
+				break;
+			default:
+				page->advice = advice;
+				break;
+		}
+	}
+	tlb_batch_finish (&batch);
+	vm_frame_unlock (locked);
+	return 0;
+}
+
+/* Moves the program break of the current process by INCREMENT bytes
+ * and returns the previous break, or (void *) -1 if the break would
+ * leave [heap_start, STACK_LIMIT) or run into a page that is already
+ * mapped.  New heap pages are lazy anonymous pages, so they read as
+ * zeros and take a frame only when written; pages that fall off the
+ * heap are freed right away. */
+void *
+vm_sbrk (intptr_t increment) {
+	struct thread *t = thread_current ();
+	struct supplemental_page_table *spt = &t->spt;
+	void *old_brk = t->heap_end;
+	void *new_brk = old_brk + increment;
+	void *old_top = pg_round_up (old_brk);
+	void *new_top = pg_round_up (new_brk);
+	struct tlb_batch batch;
+	bool locked;
+	void *va;
+
+	if (t->heap_start == NULL)
+		return (void *) -1;
+	if (increment >= 0 ? new_brk < old_brk || new_brk > (void *) STACK_LIMIT
+			: new_brk > old_brk || new_brk < t->heap_start)
+		return (void *) -1;
+
+	for (va = old_top; va < new_top; va += PGSIZE)
+		if (spt_find_page (spt, va) != NULL)
+			return (void *) -1;
+	for (va = old_top; va < new_top; va += PGSIZE)
+		if (!vm_alloc_page (VM_ANON, va, true)) {
+			new_top = va;
+			for (va = old_top; va < new_top; va += PGSIZE)
+				spt_remove_page (spt, spt_find_page (spt, va));
+			return (void *) -1;
+		}
+
+	locked = vm_frame_lock ();
+	tlb_batch_begin (&batch, t->pml4);
+	for (va = new_top; va < old_top; va += PGSIZE) {
+		struct page *page = spt_find_page (spt, va);
+
+		if (page != NULL) {
+			vm_drop_page (page);
+			spt_remove_page (spt, page);
+		}
+	}
+	tlb_batch_finish (&batch);
+	vm_frame_unlock (locked);
+
+	t->heap_end = new_brk;
+	return old_brk;
+}
+
+/* Returns true if PAGE is an anonymous page that was never written, so
+ * its content is all zeros: a stack or vm_alloc_page() page that has
+ * not been claimed yet. */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
+vm_is_fresh_anon (struct page *page) {
+	return VM_TYPE (page->operations->type) == VM_UNINIT
+		&& VM_TYPE (page->uninit.type) == VM_ANON
+		&& page->uninit.init == NULL;
+}
+
+/* Maps the shared zero frame read-only at PAGE.  The first write
+ * faults again and gets a private frame through vm_do_claim_page. */
+static bool
+vm_map_zero_page (struct page *page) {
+	if (!pml4_set_page (thread_current ()->pml4, page->va, zero_kva, false))
+		return false;
+	page->zero_mapped = true;
+	return true;
+}
+
+/* Return true on success */
+static bool
+vm_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
 	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
 	// void* stack_bottom = &thread_current()->stack_bottom;
@@ -283,11 +900,36 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		// printf("page is NULL");
 		return false;
 	}
+	else if (page->frame == NULL && not_present && thp_enabled
+			&& vm_is_fresh_anon (page) && thp_try_fault (page)){
+		return true;
+	}
+	else if (page->frame == NULL && not_present && !write
+			&& vm_is_fresh_anon (page)){
+		return vm_map_zero_page (page);
+	}
+	else if (page->frame != NULL && not_present){
+		/* Frame shared by fork, not yet in our page table. */
+		if (write)
+			return vm_handle_wp (page);
+		return pml4_set_page (thread_current ()->pml4, page->va,
+				page->frame->kva, false);
+	}
 	else if (page != NULL && page->frame == NULL && not_present){
 		// printf("check out vm_do_claim\n");
+		bool success = vm_is_cached_page (page)
+			? vm_claim_cached_page (page) : vm_do_claim_page (page);
+		if (success && page->advice == MADV_SEQUENTIAL)
+			vm_sequential_fault (page);
+		return success;
+	}
+	else if (page->zero_mapped && write && !not_present){
+		if (!page->is_writable)
+			return false;
+		pml4_clear_page (thread_current ()->pml4, page->va);
 		return vm_do_claim_page (page);
 	}
-	else if(page->frame != NULL && write && !not_present && page->frame->write_protected > 1){
+	else if(page->frame != NULL && write && !not_present){
 		// printf("check out vm_handle_wp\n");
 		return vm_handle_wp(page);
 	}
@@ -300,6 +942,25 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 	}
 }
 
+/* Handles a fault at ADDR with the frame table locked, so that no
+ * other fault evicts a frame while it is being filled or copied.  The
+ * lock is released while a pinned frame is read in or written out,
+ * unless the fault hit a kernel access that already held it.
+ * Return true on success */
+bool
+vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
+		bool write, bool not_present) {
+	struct thread *t = thread_current ();
+	bool locked = vm_frame_lock ();
+	bool success;
+
+	t->vm_io_unlock = locked;
+	success = vm_handle_fault (f, addr, user, write, not_present);
+	t->vm_io_unlock = false;
+	vm_frame_unlock (locked);
+	return success;
+}
+
 /* Free the page.
  * DO NOT MODIFY THIS FUNCTION. */
 void
@@ -316,7 +977,15 @@ vm_claim_page (void *va UNUSED) {
 	page = spt_find_page (&thread_current()->spt, va);
 	// if (page){
 	// printf("check\n");
-	return vm_do_claim_page (page);
+	struct thread *t = thread_current ();
+	bool locked = vm_frame_lock ();
+	bool success;
+
+	t->vm_io_unlock = locked;
+	success = vm_do_claim_page (page);
+	t->vm_io_unlock = false;
+	vm_frame_unlock (locked);
+	return success;
 	
 	// else{
 	// 	vm_alloc_page(VM_ANON, va, 1);
@@ -324,34 +993,49 @@ vm_claim_page (void *va UNUSED) {
 	// }
 }
 
+/* Makes the pinned FRAME, fresh from vm_get_frame(), the frame of
+ * PAGE. */
+static void
+vm_link_frame (struct page *page, struct frame *frame) {
+	frame->page = page;
+	frame->write_protected = 1;
+	list_push_back (&frame->page_list, &page->copy_elem);
+	page->frame = frame;
+	page->not_present = false;
+	page->zero_mapped = false;
+}
+
+/* Reads the content of PAGE into its pinned FRAME, then maps it and
+ * unpins the frame.  The read may run with lock_vm released: nobody
+ * evicts a pinned frame, and PAGE is mapped only once it is filled.
+ * If the read fails, a cached frame leaves the cache again. */
+static bool
+vm_fill_frame (struct page *page, struct frame *frame) {
+	uint64_t *pml4 = thread_current ()->pml4;
+	bool released = vm_io_begin ();
+	bool success = swap_in (page, frame->kva);
+
+	vm_io_end (released);
+	if (!success)
+		filemap_remove (frame);
+	/* On a mapping failure the page keeps its frame, whose content
+	 * may be gone from swap already; a later fault maps it. */
+	else if (pml4_get_page (pml4, page->va) == NULL)
+		success = pml4_set_page (pml4, page->va, frame->kva, page->is_writable);
+	frame->pinned = false;
+	cond_broadcast (&vm_io_done, &lock_vm);
+	return success;
+}
+
 /* Claim the PAGE and set up the mmu. */
 static bool
  vm_do_claim_page (struct page *page) {
 	struct frame *frame = vm_get_frame ();
 
-	/* Set links */
-
-	frame->page = page;
-	page->frame = frame;
-	// page->not_present = false;
-	// printf("page %p\n", page->va);
-	// printf("frame->page->va %p\n", frame->page->va);
-	// printf("check in vm_do_claim_page page->writable %d\n", page->is_writable);
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
-	if (pml4_get_page(thread_current()->pml4, page->va) == NULL) {// table에 해당하는 값이 없으면
-		if (!pml4_set_page(thread_current()->pml4, page->va, frame->kva, page->is_writable)) // table에 해당하는 page 넣어주고,
-			{
-				// printf("check false pml4_set_page\n");
-				return false;
-			}
-	}
-	// printf("frame_table %p\n", &frame_table);
-	// printf("frame_table begin %p\n", list_begin(&frame_table));
-	// printf("frame->list_elem %p\n", &frame->list_elem);
-	frame->write_protected = 1;
-	list_push_back(&frame->page_list, &page->copy_elem);
-	page->not_present=false;
-	return swap_in (page, frame->kva);
+	if (frame == NULL)
+		return false;
+	vm_link_frame (page, frame);
+	return vm_fill_frame (page, frame);
 }
 
 /* Initialize new supplemental page table */
@@ -360,37 +1044,94 @@ supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 	hash_init(&(spt->spt_hash), page_hash, page_less, 0);
 }
 
-/* Copy supplemental page table from src to dst */
+/* Files reopened for the child by one supplemental_page_table_copy(),
+ * so that every page of a mapping shares a single reopen. */
+#define REOPEN_MAX 16
+struct reopen_dict {
+	struct file *key[REOPEN_MAX];
+	struct file *value[REOPEN_MAX];
+	int cnt;
+};
+
+static struct file *
+reopen_lookup (struct reopen_dict *dict, struct file *file) {
+	struct file *new_file;
+
+	for (int i = 0; i < dict->cnt; i++)
+		if (dict->key[i] == file)
+			return dict->value[i];
+
+	new_file = file_reopen(file);
+	if (dict->cnt < REOPEN_MAX) {
+		dict->key[dict->cnt] = file;
+		dict->value[dict->cnt] = new_file;
+		dict->cnt++;
+	}
+	return new_file;
+}
+
+/* Copy supplemental page table from src to dst.
+ * Resident frames are shared copy-on-write: the parent's mappings lose
+ * their write bit here, but the child's page table is left empty and is
+ * filled in by vm_try_handle_fault() on first touch.  Fork thus costs
+ * one page struct per page, not one page table update per frame. */
 bool
 supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		struct supplemental_page_table *src UNUSED) {
 	struct hash_iterator i;
+	struct reopen_dict dict;
 	bool success = true;
+
+	dict.cnt = 0;
 	hash_first (&i, &src->spt_hash);
 	
 	while (hash_next(&i)){
 		struct page *src_page = hash_entry (hash_cur(&i), struct page, hash_elem);
 		struct page *dst_page = (struct page *)malloc(sizeof(struct page));
+		if (dst_page == NULL)
+			return false;
 	
+		/* Copy and share under the lock, so that the frame is not
+		 * evicted halfway.  Reopening the file needs no frame and
+		 * waits until after. */
+		bool locked = vm_frame_lock ();
 		memcpy(dst_page, src_page, sizeof(struct page));
+		/* The child maps the zero frame again on its own first read. */
+		dst_page->zero_mapped = false;
+		dst_page->owner = thread_current ();
+		/* Both copies keep the swapped out content alive. */
+		if (VM_TYPE (src_page->operations->type) == VM_ANON
+				&& src_page->anon.swap != NULL)
+			zswap_dup (src_page->anon.swap);
 		
-		if (src_page->frame){
-			
+		bool shared = src_page->frame != NULL;
+		if (shared){
+			struct thread *parent = src_page->owner;
+
 			list_push_back(&src_page->frame->page_list, &dst_page->copy_elem);
 			src_page->frame->write_protected++;
-			pml4_set_page(thread_current()->pml4, dst_page->va, dst_page->frame->kva, 0);
+			if (parent != NULL && parent->pml4 != NULL)
+				pml4_set_writable (parent->pml4, src_page->va, false);
+		}
+		vm_frame_unlock (locked);
 
+		if (shared){
 			if(src_page->uninit.aux != NULL) {
 				struct file_info *file_info = (struct file_info *)malloc(sizeof(struct file_info));
 				memcpy(file_info, src_page->uninit.aux, sizeof(struct file_info));
 				if(page_get_type(src_page) == VM_FILE)
-				{
-					lock_acquire(&lock_read);
-					file_info->file = file_reopen(file_info->file);
-					lock_release(&lock_read);
-				}
+					file_info->file = reopen_lookup (&dict, file_info->file);
 				dst_page->uninit.aux = file_info;
 			}
+		} else if (page_get_type (src_page) == VM_ANON && src_page->uninit.aux != NULL
+				&& ((struct file_info *) src_page->uninit.aux)->file == NULL) {
+			/* An anonymous mapping: munmap() in either process frees
+			 * the file_info, so the child gets its own. */
+			struct file_info *file_info = malloc (sizeof *file_info);
+			if (file_info == NULL)
+				return false;
+			memcpy (file_info, src_page->uninit.aux, sizeof *file_info);
+			dst_page->uninit.aux = file_info;
 		}
 		success &= spt_insert_page(dst, dst_page);
 	}
@@ -403,7 +1144,23 @@ supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	/* TODO: Destroy all the supplemental_page_table hold by thread and
 	 * TODO: writeback all the modified contents to the storage. */
 	struct hash_iterator i;
-	// lock_acquire(&lock_kill);
+	struct tlb_batch batch;
+	void *bounce = palloc_get_page (0);
+	bool locked;
+
+	/* Write the mapped files back before taking lock_vm, see
+	 * file_writeback_unlocked().  Pages still dirty after, if no bounce
+	 * page was left, are written by their destruction. */
+	if (bounce != NULL) {
+		hash_first (&i, &spt->spt_hash);
+		while (hash_next (&i))
+			file_writeback_unlocked (hash_entry (hash_cur (&i), struct page,
+						hash_elem), bounce);
+		palloc_free_page (bounce);
+	}
+
+	locked = vm_frame_lock ();
+	tlb_batch_begin (&batch, thread_current ()->pml4);
 	// printf("check current thread_name %s-%d\n", thread_name(), thread_tid());
 	while (!hash_empty(&spt->spt_hash)){
 		hash_first (&i, &spt->spt_hash);
@@ -414,7 +1171,6 @@ supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 		{
 			if (target->frame->write_protected == 1) 
 			{
-				list_remove(&target->frame->list_e); // 원본인 경우 frame list_e에서 제거.
 				if (target->uninit.type == VM_FILE) {
 					struct file_info *file_info = (struct file_info*) target->uninit.aux;
 
@@ -425,6 +1181,22 @@ supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 		}
 		spt_remove_page(spt, target);
 	}
+	tlb_batch_finish (&batch);
+	vm_frame_unlock (locked);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	zswap_print_stats ();
+	ksm_print_stats ();
+	filemap_print_stats ();
+	tlb_print_stats ();
+	printf ("Evict (%s): %lld clean, %lld dirty frames\n",
+			vm_evict_policy == EVICT_2Q ? "2q" : "clock",
+			evict_clean, evict_dirty);
+	if (thp_enabled)
+		thp_print_stats ();
 }
 
 unsigned
@@ -0,0 +1,448 @@
+/* zswap.c: Compressed in-memory swap tier.
+ *
+ * Anonymous pages evicted by anon_swap_out() land here first.  A page
+ * that is entirely zero is only recorded as a flag.  Any other page is
+ * compressed with a small LZ77 coder (plain C, no SSE, so it is safe
+ * to run inside the kernel) and the result is kept in half of a page
+ * of the kernel pool, two compressed pages to a pool page (as zbud
+ * does).  When the pool pages of the compressed tier take more than
+ * ZSWAP_MAX_BYTES, the coldest entries are spilled to the swap disk.
+ * Pages that do not compress to half a page skip the RAM tier and go
+ * to the disk right away. */
+
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Upper bound of kernel pool memory taken by the RAM tier. */
+#define ZSWAP_MAX_BYTES (256 * 1024)
+
+/* Pages that do not shrink to this size are stored on disk. */
+#define ZSWAP_MAX_CLEN (PGSIZE / 2)
+
+/* A pool page that holds two compressed pages, one in each half. */
+struct zbud_page {
+	struct list_elem elem;      /* Element of zbud_free, if a half is free. */
+	uint8_t *kva;               /* The page. */
+	bool used[2];               /* Halves in use. */
+};
+
+/* Memory a zbud_page takes, charged against ZSWAP_MAX_BYTES. */
+#define ZBUD_BYTES (PGSIZE + sizeof (struct zbud_page))
+
+/* Where the content of a swapped out page lives. */
+enum zswap_state {
+	ZSWAP_ZERO,                 /* Zero filled, no payload. */
+	ZSWAP_RAM,                  /* Compressed in DATA. */
+	ZSWAP_DISK                  /* Uncompressed in swap slot SLOT. */
+};
+
+struct zswap_entry {
+	enum zswap_state state;
+	int ref_cnt;                /* Pages referring this entry (fork). */
+	struct zbud_page *zbud;     /* Page that holds DATA. */
+	void *data;                 /* Compressed bytes, a half of ZBUD. */
+	size_t len;                 /* Length of DATA. */
+	size_t slot;                /* Swap slot on the swap disk. */
+	struct list_elem lru_elem;  /* Element of zswap_lru. */
+};
+
+/* Entries of the RAM tier, coldest first. */
+static struct list zswap_lru;
+static struct list zbud_free;   /* zbud_pages with a free half. */
+static size_t zswap_ram_bytes;  /* Memory of all zbud_pages. */
+static struct lock zswap_lock;
+
+/* Scratch pages, protected by zswap_lock. */
+static uint8_t *zswap_cbuf;     /* Compressor output. */
+static uint8_t *zswap_pbuf;     /* Decompressed page for spilling. */
+
+/* Statistics. */
+static long long zswap_zero_cnt;      /* Zero pages stored. */
+static long long zswap_ram_cnt;       /* Pages compressed into RAM. */
+static long long zswap_disk_cnt;      /* Incompressible pages to disk. */
+static long long zswap_spill_cnt;     /* RAM entries spilled to disk. */
+static long long zswap_bytes_in;      /* Uncompressed bytes in RAM tier. */
+static long long zswap_bytes_out;     /* Compressed bytes in RAM tier. */
+static long long zswap_zero_hits;
+static long long zswap_ram_hits;
+static long long zswap_disk_hits;
+
+static bool zswap_to_disk (struct zswap_entry *entry, const void *kva);
+static void zswap_shrink (void);
+
+/*----------------------------------------------------------------------------*/
+/* LZ77 coder                                                                 */
+/*----------------------------------------------------------------------------*/
+
+/* The stream is a list of sequences.  Each sequence is a token byte
+ * (high nibble: literal length, low nibble: match length - LZ_MIN_MATCH),
+ * extra length bytes when a nibble is 15, the literals, a 2 byte little
+ * endian match offset and extra match length bytes.  The last sequence
+ * holds only literals. */
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t
+lz_read32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+static inline size_t
+lz_hash (uint32_t seq) {
+	return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the extension bytes of LEN (>= 15) to OP.
+ * Returns the new output pointer or NULL on overflow. */
+static uint8_t *
+lz_put_len (uint8_t *op, uint8_t *oend, size_t len) {
+	for (len -= 15; op < oend; len -= 255) {
+		if (len < 255) {
+			*op++ = len;
+			return op;
+		}
+		*op++ = 255;
+	}
+	return NULL;
+}
+
+/* Emits one sequence of LIT_LEN literals followed by a match of MLEN
+ * bytes at OFFSET.  MLEN of 0 emits the final literal-only sequence. */
+static uint8_t *
+lz_emit (uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t lit_len,
+		size_t offset, size_t mlen) {
+	size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+	uint8_t *token = op++;
+
+	if (token >= oend)
+		return NULL;
+	*token = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+	if (lit_len >= 15 && (op = lz_put_len (op, oend, lit_len)) == NULL)
+		return NULL;
+	if ((size_t) (oend - op) < lit_len)
+		return NULL;
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+	if (mlen == 0)
+		return op;
+
+	if (oend - op < 2)
+		return NULL;
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+	if (ml >= 15)
+		op = lz_put_len (op, oend, ml);
+	return op;
+}
+
+/* Compresses N bytes at SRC into DST of CAP bytes.
+ * Returns the compressed length, or 0 if it does not fit. */
+static size_t
+lz_compress (const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+	const uint8_t *ip = src, *anchor = src, *end = src + n;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	ASSERT (n <= UINT16_MAX);
+	memset (lz_table, 0, sizeof lz_table);
+	while (ip + LZ_MIN_MATCH <= end) {
+		uint32_t seq = lz_read32 (ip);
+		size_t h = lz_hash (seq);
+		const uint8_t *ref = src + lz_table[h];
+		size_t mlen = LZ_MIN_MATCH;
+
+		lz_table[h] = ip - src;
+		if (ref >= ip || lz_read32 (ref) != seq) {
+			ip++;
+			continue;
+		}
+		while (ip + mlen < end && ref[mlen] == ip[mlen])
+			mlen++;
+		op = lz_emit (op, oend, anchor, ip - anchor, ip - ref, mlen);
+		if (op == NULL)
+			return 0;
+		ip += mlen;
+		anchor = ip;
+	}
+	op = lz_emit (op, oend, anchor, end - anchor, 0, 0);
+	return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads the extension bytes of a length nibble. */
+static size_t
+lz_get_len (const uint8_t **ipp, const uint8_t *iend) {
+	const uint8_t *ip = *ipp;
+	size_t len = 0;
+	uint8_t b;
+
+	do {
+		if (ip >= iend)
+			break;
+		b = *ip++;
+		len += b;
+	} while (b == 255);
+	*ipp = ip;
+	return len;
+}
+
+/* Decompresses N bytes at SRC into exactly CAP bytes at DST.
+ * Returns false if the stream is corrupted. */
+static bool
+lz_decompress (const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+	const uint8_t *ip = src, *iend = src + n;
+	uint8_t *op = dst, *oend = dst + cap;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+		size_t lit = token >> 4;
+		size_t ml = token & 15;
+		size_t offset;
+
+		if (lit == 15)
+			lit += lz_get_len (&ip, iend);
+		if (lit > (size_t) (iend - ip) || lit > (size_t) (oend - op))
+			return false;
+		memcpy (op, ip, lit);
+		op += lit;
+		ip += lit;
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return false;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (ml == 15)
+			ml += lz_get_len (&ip, iend);
+		ml += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| ml > (size_t) (oend - op))
+			return false;
+
+		/* Byte by byte, the match may overlap the output. */
+		for (const uint8_t *ref = op - offset; ml > 0; ml--)
+			*op++ = *ref++;
+	}
+	return op == oend;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Swap tiers                                                                 */
+/*----------------------------------------------------------------------------*/
+
+/* Initializes the compressed swap tier. */
+void
+zswap_init (void) {
+	list_init (&zswap_lru);
+	list_init (&zbud_free);
+	lock_init (&zswap_lock);
+	zswap_cbuf = palloc_get_page (PAL_ASSERT);
+	zswap_pbuf = palloc_get_page (PAL_ASSERT);
+}
+
+static bool
+page_is_zero (const void *kva) {
+	const uint64_t *p = kva;
+	for (size_t i = 0; i < PGSIZE / sizeof *p; i++)
+		if (p[i] != 0)
+			return false;
+	return true;
+}
+
+/* Puts the LEN bytes compressed into zswap_cbuf into a free half of a
+ * zbud_page, for ENTRY.  Returns false if the pool is out of memory. */
+static bool
+zbud_store (struct zswap_entry *entry, size_t len) {
+	struct zbud_page *zbud;
+	int half;
+
+	ASSERT (len <= PGSIZE / 2);
+	if (!list_empty (&zbud_free))
+		zbud = list_entry (list_pop_front (&zbud_free), struct zbud_page, elem);
+	else {
+		zbud = malloc (sizeof *zbud);
+		if (zbud == NULL)
+			return false;
+		zbud->kva = palloc_get_page (0);
+		if (zbud->kva == NULL) {
+			free (zbud);
+			return false;
+		}
+		zbud->used[0] = zbud->used[1] = false;
+		zswap_ram_bytes += ZBUD_BYTES;
+	}
+
+	half = zbud->used[0] ? 1 : 0;
+	zbud->used[half] = true;
+	if (!zbud->used[!half])
+		list_push_back (&zbud_free, &zbud->elem);
+	entry->zbud = zbud;
+	entry->data = zbud->kva + half * (PGSIZE / 2);
+	entry->len = len;
+	memcpy (entry->data, zswap_cbuf, len);
+	return true;
+}
+
+/* Gives back the half page of ENTRY, and its zbud_page once both
+ * halves are free. */
+static void
+zbud_release (struct zswap_entry *entry) {
+	struct zbud_page *zbud = entry->zbud;
+
+	zbud->used[entry->data != zbud->kva] = false;
+	if (!zbud->used[0] && !zbud->used[1]) {
+		list_remove (&zbud->elem);
+		palloc_free_page (zbud->kva);
+		free (zbud);
+		zswap_ram_bytes -= ZBUD_BYTES;
+	} else
+		list_push_back (&zbud_free, &zbud->elem);
+	entry->zbud = NULL;
+	entry->data = NULL;
+	entry->len = 0;
+}
+
+/* Saves the page at KVA and returns the entry that holds it, or NULL
+ * if neither the kernel pool nor the swap disk has room left. */
+struct zswap_entry *
+zswap_store (const void *kva) {
+	struct zswap_entry *entry = malloc (sizeof *entry);
+	size_t len;
+
+	if (entry == NULL)
+		return NULL;
+	entry->ref_cnt = 1;
+	entry->zbud = NULL;
+	entry->data = NULL;
+	entry->len = 0;
+
+	lock_acquire (&zswap_lock);
+	if (page_is_zero (kva)) {
+		entry->state = ZSWAP_ZERO;
+		zswap_zero_cnt++;
+	} else if ((len = lz_compress (kva, PGSIZE, zswap_cbuf, ZSWAP_MAX_CLEN)) > 0
+			&& zbud_store (entry, len)) {
+		entry->state = ZSWAP_RAM;
+		list_push_back (&zswap_lru, &entry->lru_elem);
+		zswap_ram_cnt++;
+		zswap_bytes_in += PGSIZE;
+		zswap_bytes_out += len;
+		zswap_shrink ();
+	} else if (zswap_to_disk (entry, kva)) {
+		zswap_disk_cnt++;
+	} else {
+		free (entry);
+		entry = NULL;
+	}
+	lock_release (&zswap_lock);
+	return entry;
+}
+
+/* Reads the page held by ENTRY into KVA.  ENTRY stays valid, the caller
+ * drops it with zswap_free(). */
+bool
+zswap_load (struct zswap_entry *entry, void *kva) {
+	bool success = true;
+
+	lock_acquire (&zswap_lock);
+	switch (entry->state) {
+		case ZSWAP_ZERO:
+			memset (kva, 0, PGSIZE);
+			zswap_zero_hits++;
+			break;
+		case ZSWAP_RAM:
+			success = lz_decompress (entry->data, entry->len, kva, PGSIZE);
+			zswap_ram_hits++;
+			break;
+		case ZSWAP_DISK:
+			swap_slot_read (entry->slot, kva);
+			zswap_disk_hits++;
+			break;
+	}
+	lock_release (&zswap_lock);
+	return success;
+}
+
+/* Adds a reference to ENTRY, used when a swapped out page is shared by
+ * a forked child. */
+struct zswap_entry *
+zswap_dup (struct zswap_entry *entry) {
+	lock_acquire (&zswap_lock);
+	entry->ref_cnt++;
+	lock_release (&zswap_lock);
+	return entry;
+}
+
+/* Drops a reference to ENTRY, releasing its payload or swap slot on
+ * the last one. */
+void
+zswap_free (struct zswap_entry *entry) {
+	lock_acquire (&zswap_lock);
+	if (--entry->ref_cnt > 0) {
+		lock_release (&zswap_lock);
+		return;
+	}
+	if (entry->state == ZSWAP_RAM) {
+		list_remove (&entry->lru_elem);
+		zbud_release (entry);
+	} else if (entry->state == ZSWAP_DISK)
+		swap_slot_free (entry->slot);
+	lock_release (&zswap_lock);
+	free (entry);
+}
+
+/* Prints swap statistics. */
+void
+zswap_print_stats (void) {
+	printf ("Swap: %lld zero, %lld compressed (%lld -> %lld bytes), "
+			"%lld to disk, %lld spilled\n",
+			zswap_zero_cnt, zswap_ram_cnt, zswap_bytes_in, zswap_bytes_out,
+			zswap_disk_cnt, zswap_spill_cnt);
+	printf ("Swap: %lld zero hits, %lld RAM hits, %lld disk hits\n",
+			zswap_zero_hits, zswap_ram_hits, zswap_disk_hits);
+}
+
+/* Moves ENTRY to a swap slot holding KVA. */
+static bool
+zswap_to_disk (struct zswap_entry *entry, const void *kva) {
+	size_t slot = swap_slot_write (kva);
+	if (slot == BITMAP_ERROR)
+		return false;
+	entry->state = ZSWAP_DISK;
+	entry->slot = slot;
+	return true;
+}
+
+/* Spills the coldest entries to the swap disk until the RAM tier is
+ * back under its budget.  A pool page is only given back once both of
+ * its halves are spilled or freed. */
+static void
+zswap_shrink (void) {
+	ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+	while (zswap_ram_bytes > ZSWAP_MAX_BYTES && !list_empty (&zswap_lru)) {
+		struct zswap_entry *entry = list_entry (list_front (&zswap_lru),
+				struct zswap_entry, lru_elem);
+
+		if (!lz_decompress (entry->data, entry->len, zswap_pbuf, PGSIZE))
+			PANIC ("zswap: corrupted entry");
+		if (!zswap_to_disk (entry, zswap_pbuf))
+			break;
+		list_remove (&entry->lru_elem);
+		zbud_release (entry);
+		zswap_spill_cnt++;
+	}
+}